@@ -0,0 +1,157 @@
+#include "types.h"
+#include "param.h"
+#include "layout.h"
+#include "riscv.h"
+#include "defs.h"
+#include "buf.h"
+
+/* CSE 536: Measured-boot cache for warm reboots.
+ *
+ * After a full verification, hart 0 leaves a record of the NORMAL image
+ * in RAM that survives a warm reset: its size, its leading header bytes,
+ * a SHA-256 over one block in every BOOTCACHE_STRIDE and the verified
+ * measurement. The record is authenticated with an HMAC keyed by the
+ * per-build bootcache_key from measurements.h. S-mode may read all of
+ * RAM (the PMP tests expect the bootloader pages to be readable), so the
+ * key is wiped before any kernel runs. QEMU reloads the bootloader
+ * image, and with it the key, on every reset; if it ever finds the key
+ * wiped the cache stays off rather than trust an unkeyed record. While
+ * the record matches,
+ * the full hash is skipped; after BOOTCACHE_FULL warm boots, or as soon
+ * as anything differs, the image is hashed in full again. A hit only
+ * checks the sampled blocks, so this is built only with BOOTCACHE=1. */
+
+#define BOOTCACHE_MAGIC 0x48434f42  // "BOCH"
+#define BOOTCACHE_HDRSZ 64          // covers the ELF and kimg headers
+
+struct bootcache {
+  uint magic;
+  uint boots;       // warm boots since the last full verification
+  uint64 size;
+  BYTE header[BOOTCACHE_HDRSZ];
+  BYTE sample[SHA256_BLOCK_SIZE];
+  BYTE root[SHA256_BLOCK_SIZE];
+  BYTE mac[SHA256_BLOCK_SIZE];  // HMAC-SHA256 over everything above
+};
+
+/* Returns 1 while the key has not been wiped. */
+static int
+bootcache_keyed(void)
+{
+  for (int i = 0; i < sizeof(bootcache_key); i++)
+    if (bootcache_key[i])
+      return 1;
+  return 0;
+}
+
+static void
+hmac_sha256(const BYTE *msg, uint64 len, BYTE mac[SHA256_BLOCK_SIZE])
+{
+  BYTE pad[64], inner[SHA256_BLOCK_SIZE];
+  SHA256_CTX ctx;
+
+  for (int i = 0; i < 64; i++)
+    pad[i] = (i < sizeof(bootcache_key) ? bootcache_key[i] : 0) ^ 0x36;
+  sha256_init(&ctx);
+  sha256_update(&ctx, pad, 64);
+  sha256_update(&ctx, msg, len);
+  sha256_final(&ctx, inner);
+
+  for (int i = 0; i < 64; i++)
+    pad[i] ^= 0x36 ^ 0x5c;
+  sha256_init(&ctx);
+  sha256_update(&ctx, pad, 64);
+  sha256_update(&ctx, inner, SHA256_BLOCK_SIZE);
+  sha256_final(&ctx, mac);
+}
+
+static void
+bootcache_mac(struct bootcache *bc, BYTE mac[SHA256_BLOCK_SIZE])
+{
+  hmac_sha256((const BYTE *)bc, (char *)bc->mac - (char *)bc, mac);
+}
+
+/* Fill in the size, header and sampled-block digest of an image. */
+static void
+bootcache_fingerprint(enum kernel ktype, struct bootcache *bc)
+{
+  BYTE *disk = (BYTE *)(uint64)(ktype == NORMAL ? RAMDISK : RECOVERYDISK);
+  SHA256_CTX ctx;
+
+  bc->size = find_kernel_size(ktype);
+  memmove(bc->header, disk, BOOTCACHE_HDRSZ);
+
+  sha256_init(&ctx);
+  for (uint64 off = 0; off < bc->size; off += BOOTCACHE_STRIDE * BSIZE) {
+    uint64 n = (bc->size - off < BSIZE) ? bc->size - off : BSIZE;
+    sha256_update(&ctx, disk + off, n);
+  }
+  /* the tail block is always sampled */
+  if (bc->size > BSIZE)
+    sha256_update(&ctx, disk + bc->size - BSIZE, BSIZE);
+  sha256_final(&ctx, bc->sample);
+}
+
+/* Returns 1 if a valid record vouches for the image having the given
+ * measurement, counting this as one more warm boot. */
+int
+bootcache_lookup(enum kernel ktype, const BYTE root[SHA256_BLOCK_SIZE])
+{
+  struct bootcache *bc = (struct bootcache *)BOOTCACHE_ADDR;
+  struct bootcache cur;
+  BYTE mac[SHA256_BLOCK_SIZE];
+
+  if (bc->magic != BOOTCACHE_MAGIC || !bootcache_keyed() || !kernel_check(ktype))
+    return 0;
+  bootcache_mac(bc, mac);
+  if (memcmp(mac, bc->mac, SHA256_BLOCK_SIZE) != 0)
+    return 0;
+  if (bc->boots + 1 >= BOOTCACHE_FULL)
+    return 0;
+  if (memcmp(bc->root, root, SHA256_BLOCK_SIZE) != 0)
+    return 0;
+
+  bootcache_fingerprint(ktype, &cur);
+  if (cur.size != bc->size ||
+      memcmp(cur.header, bc->header, BOOTCACHE_HDRSZ) != 0 ||
+      memcmp(cur.sample, bc->sample, SHA256_BLOCK_SIZE) != 0)
+    return 0;
+
+  bc->boots++;
+  bootcache_mac(bc, bc->mac);
+  return 1;
+}
+
+/* Record an image whose full measurement was just verified. */
+void
+bootcache_save(enum kernel ktype, const BYTE root[SHA256_BLOCK_SIZE])
+{
+  struct bootcache *bc = (struct bootcache *)BOOTCACHE_ADDR;
+
+  if (!bootcache_keyed()) {
+    bootcache_clear();
+    return;
+  }
+  bc->magic = BOOTCACHE_MAGIC;
+  bc->boots = 0;
+  bootcache_fingerprint(ktype, bc);
+  memmove(bc->root, root, SHA256_BLOCK_SIZE);
+  bootcache_mac(bc, bc->mac);
+}
+
+void
+bootcache_clear(void)
+{
+  struct bootcache *bc = (struct bootcache *)BOOTCACHE_ADDR;
+
+  memset(bc, 0, sizeof(*bc));
+}
+
+/* Called by hart 0 once the cache has been used for this boot, before
+ * any kernel can read the key. */
+void
+bootcache_forget_key(void)
+{
+  memset(bootcache_key, 0, sizeof(bootcache_key));
+  __sync_synchronize();
+}
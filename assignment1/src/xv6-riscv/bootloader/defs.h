@@ -17,8 +17,26 @@ enum kernel {
     RECOVERY
 };
 
+/* Boot phases timed in sys_info, in the order hart 0 completes them */
+enum boot_phase {
+    BP_START,   // entered start()
+    BP_PMP,     // PMP programmed
+    BP_ELF,     // NORMAL kernel headers parsed
+    BP_HASH,    // NORMAL kernel measured (and streamed into place)
+    BP_DECIDE,  // secure-boot / recovery decision made
+    BP_COPY,    // chosen kernel fully loaded
+    BP_MRET,    // about to mret into the kernel
+    BP_NPHASE
+};
+
+// start.c
+extern volatile uint64 boot_gen;
+
 // load.c
-void            kernel_copy(enum kernel ktype, struct buf* b);
+extern uint64   bytes_hashed;
+extern uint64   bytes_copied;
+void            kernel_load(enum kernel ktype, SHA256_CTX *ctx);
+void            kernel_load_range(enum kernel ktype, uint64 lo, uint64 hi, SHA256_CTX *ctx);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -35,9 +53,45 @@ int             assert_stack_address(void);
 void            panic(char *s);
 
 // elf.c
-uint64 find_kernel_load_addr(enum kernel ktype);
+int kernel_check(enum kernel ktype);
+void kernel_unload(enum kernel ktype);
 uint64 find_kernel_size(enum kernel ktype);
 uint64 find_kernel_entry_addr(enum kernel ktype);
+uint64 kernel_load_segments(enum kernel ktype, uint64 lo, uint64 hi);
+uint64 kernel_finish_load(enum kernel ktype);
+
+// pmp.c
+struct pmp_region {
+  uint64 base;
+  uint64 size;
+  uint8 perm;  // PMP_R | PMP_W | PMP_X
+};
+int             pmp_plan(const struct pmp_region *r, int n, uint64 *addr, uint8 *cfg);
+void            pmp_setup(const struct pmp_region *r, int n);
+
+// bootcache.c
+extern BYTE     bootcache_key[32];
+int             bootcache_lookup(enum kernel ktype, const BYTE root[SHA256_BLOCK_SIZE]);
+void            bootcache_save(enum kernel ktype, const BYTE root[SHA256_BLOCK_SIZE]);
+void            bootcache_clear(void);
+void            bootcache_forget_key(void);
+
+// printf.c
+void            printf(char *fmt, ...);
+
+// sha256.c
+void            sha256_select(void);
+void            sha256_bench(const BYTE data[], size_t len);
+
+// lz4.c
+int             lz4_decompress(const uchar *src, uint64 srclen, uchar *dst, uint64 dstlen);
+
+// merkle.c
+void            merkle_reset(void);
+int             merkle_begin(enum kernel ktype, int measure);
+void            merkle_work(void);
+void            merkle_wait(void);
+void            merkle_root(BYTE root[SHA256_BLOCK_SIZE]);
 
 // Tracking the end of various sections
 extern uint64 ecode;    // end of text
@@ -51,4 +105,13 @@ extern uint64 end;      // end of binary
 
 /* Location of the QEMU ramdisk. */
 #define RAMDISK         0x84000000
-#define RECOVERYDISK    0x84500000
\ No newline at end of file
+#define RECOVERYDISK    0x84500000
+#define KERNIMG_MAX     (RECOVERYDISK - RAMDISK)  // bytes in one kernel image slot
+
+/* Physical memory a kernel may be loaded into: above the bootloader,
+ * sys_info and the boot cache, and below the ramdisks. */
+#define KERNLOAD        0x81000000
+#define KERNLOAD_END    RAMDISK
+
+/* Warm-boot measurement record, in the page after sys_info. */
+#define BOOTCACHE_ADDR  0x80081000
@@ -5,40 +5,172 @@
 #include "defs.h"
 #include "buf.h"
 #include "elf.h"
+#include "kimg.h"
 
 #include <stdbool.h>
 
-struct elfhdr* kernel_elfhdr;
-struct proghdr* kernel_phdr;
-
-uint64 find_kernel_load_addr(enum kernel ktype) {
-    /* CSE 536: Get kernel load address from headers */
-    uint64 result_val;
-    uint64 addr_disk;
-    if(ktype == NORMAL){
-	addr_disk = RAMDISK;
-   }
-    else{
-   	addr_disk = 0x84500000; 
+/* CSE 536: Headers are read straight from the image every time (no
+ * cached pointers) so that every hart can call these concurrently. */
+static struct elfhdr* kernel_elfhdr(enum kernel ktype) {
+    if (ktype == NORMAL)
+        return (struct elfhdr*)RAMDISK;
+    return (struct elfhdr*)RECOVERYDISK;
+}
+
+/* CSE 536: Return the i-th program header of a kernel binary. */
+static struct proghdr* kernel_proghdr(struct elfhdr* elf, int i) {
+    return (struct proghdr*)((char *)elf + elf->phoff + i * elf->phentsize);
+}
+
+/* CSE 536: Does [base, base + len) lie inside [lo, hi)? */
+static bool in_range(uint64 base, uint64 len, uint64 lo, uint64 hi) {
+    return base >= lo && base <= hi && len <= hi - base;
+}
+
+/* CSE 536: Check a kernel's headers before any of it is copied. The
+ * image must fit its ramdisk slot, every header and segment must lie
+ * inside the image, no segment may have more file bytes than memory
+ * bytes, and every segment must land between KERNLOAD and KERNLOAD_END.
+ * Not even a tampered image can then overwrite the bootloader, sys_info,
+ * the boot cache or the ramdisks before it has been measured. A bad
+ * header is reported like a failed measurement. Returns 1 if the image
+ * may be loaded. */
+int kernel_check(enum kernel ktype) {
+    struct elfhdr* elf = kernel_elfhdr(ktype);
+    uint64 size;
+
+    if (elf->magic == KIMG_MAGIC) {
+        struct kimghdr* hdr = (struct kimghdr*)elf;
+        struct kimgseg* seg = (struct kimgseg*)(hdr + 1);
+
+        size = hdr->size;
+        if (size > KERNIMG_MAX || size < sizeof(*hdr) ||
+            hdr->nseg > (size - sizeof(*hdr)) / sizeof(*seg))
+            return 0;
+        for (int i = 0; i < hdr->nseg; i++, seg++) {
+            if (!in_range(seg->off, seg->csize, 0, size) ||
+                seg->filesz > seg->memsz ||
+                !in_range(seg->paddr, seg->memsz, KERNLOAD, KERNLOAD_END))
+                return 0;
+        }
+        return 1;
+    }
+
+    if (elf->magic != ELF_MAGIC)
+        return 0;
+    if (elf->shoff > KERNIMG_MAX || find_kernel_size(ktype) > KERNIMG_MAX)
+        return 0;
+    size = find_kernel_size(ktype);
+    if (size < sizeof(*elf) || elf->phentsize < sizeof(struct proghdr) ||
+        !in_range(elf->phoff, (uint64)elf->phnum * elf->phentsize, 0, size))
+        return 0;
+    for (int i = 0; i < elf->phnum; i++) {
+        struct proghdr* ph = kernel_proghdr(elf, i);
+        if (ph->type != ELF_PROG_LOAD)
+            continue;
+        if (!in_range(ph->off, ph->filesz, 0, size) ||
+            ph->filesz > ph->memsz ||
+            !in_range(ph->paddr, ph->memsz, KERNLOAD, KERNLOAD_END))
+            return 0;
+    }
+    return 1;
+}
+
+/* CSE 536: Copy the part of file bytes [lo, hi) that falls inside any
+ * PT_LOAD segment straight from the ramdisk to the segment's physical
+ * address. Only filesz bytes of each segment are ever copied. Compressed
+ * images are left alone here and expanded by kernel_finish_load().
+ * The headers must have passed kernel_check(). Returns the number of
+ * bytes copied. */
+uint64 kernel_load_segments(enum kernel ktype, uint64 lo, uint64 hi) {
+    struct elfhdr* elf = kernel_elfhdr(ktype);
+    uint64 copied = 0;
+    if (elf->magic != ELF_MAGIC)
+        return 0;
+
+    for (int i = 0; i < elf->phnum; i++) {
+        struct proghdr* ph = kernel_proghdr(elf, i);
+        if (ph->type != ELF_PROG_LOAD)
+            continue;
+
+        uint64 start = lo > ph->off ? lo : ph->off;
+        uint64 stop = hi < ph->off + ph->filesz ? hi : ph->off + ph->filesz;
+        if (start >= stop)
+            continue;
+
+        memmove((char *)ph->paddr + (start - ph->off), (char *)elf + start, stop - start);
+        copied += stop - start;
+    }
+    return copied;
+}
+
+/* CSE 536: Expand every LZ4 segment of a compressed image straight
+ * to its load address. Returns the number of bytes expanded. */
+static uint64 kimg_unpack(struct kimghdr* hdr) {
+    struct kimgseg* seg = (struct kimgseg*)(hdr + 1);
+    uint64 copied = 0;
+
+    for (int i = 0; i < hdr->nseg; i++, seg++) {
+        int n = lz4_decompress((uchar *)hdr + seg->off, seg->csize,
+                               (uchar *)seg->paddr, seg->filesz);
+        if (n != seg->filesz)
+            panic("kimg: bad segment");
+        if (seg->memsz > seg->filesz)
+            memset((char *)seg->paddr + seg->filesz, 0, seg->memsz - seg->filesz);
+        copied += n;
     }
-       kernel_elfhdr = (struct elfhdr*)addr_disk;
-    
-       kernel_phdr = (struct proghdr*)(addr_disk + kernel_elfhdr->phoff);
-       kernel_phdr = (struct proghdr*)((char *)kernel_phdr + kernel_elfhdr->phentsize);
-       result_val =  kernel_phdr->vaddr;
- 
+    return copied;
+}
+
+/* CSE 536: Finish a load once every file byte has been streamed through
+ * kernel_load_range(): expand a compressed image, or zero-fill the
+ * memsz - filesz (BSS) tail of every PT_LOAD segment. Returns the number
+ * of kernel bytes written from the image (BSS zeroing is not counted). */
+uint64 kernel_finish_load(enum kernel ktype) {
+    struct elfhdr* elf = kernel_elfhdr(ktype);
+
+    if (elf->magic == KIMG_MAGIC)
+        return kimg_unpack((struct kimghdr*)elf);
 
-    return result_val;
+    for (int i = 0; i < elf->phnum; i++) {
+        struct proghdr* ph = kernel_proghdr(elf, i);
+        if (ph->type != ELF_PROG_LOAD || ph->memsz <= ph->filesz)
+            continue;
+
+        memset((char *)ph->paddr + ph->filesz, 0, ph->memsz - ph->filesz);
+    }
+    return 0;
+}
+
+/* CSE 536: Wipe whatever kernel_load_segments() copied of an image that
+ * failed verification, so none of it is left in RAM under the RECOVERY
+ * kernel. Compressed images are only expanded once verified and have
+ * nothing to wipe. Only called on images that passed kernel_check(). */
+void kernel_unload(enum kernel ktype) {
+    struct elfhdr* elf = kernel_elfhdr(ktype);
+
+    if (elf->magic != ELF_MAGIC)
+        return;
+
+    for (int i = 0; i < elf->phnum; i++) {
+        struct proghdr* ph = kernel_proghdr(elf, i);
+        if (ph->type == ELF_PROG_LOAD)
+            memset((char *)ph->paddr, 0, ph->memsz);
+    }
 }
 
 uint64 find_kernel_size(enum kernel ktype) {
     /* CSE 536: Get kernel binary size from headers */
-    uint64 kernel_size = kernel_elfhdr->shoff + (kernel_elfhdr->shentsize * kernel_elfhdr->shnum);
-    return kernel_size;
+    struct elfhdr* elf = kernel_elfhdr(ktype);
+    if (elf->magic == KIMG_MAGIC)
+        return ((struct kimghdr*)elf)->size;
+    return elf->shoff + (elf->shentsize * elf->shnum);
 }
 
 uint64 find_kernel_entry_addr(enum kernel ktype) {
     /* CSE 536: Get kernel entry point from headers */
-    
-    return kernel_elfhdr->entry;
+    struct elfhdr* elf = kernel_elfhdr(ktype);
+    if (elf->magic == KIMG_MAGIC)
+        return ((struct kimghdr*)elf)->entry;
+    return elf->entry;
 }
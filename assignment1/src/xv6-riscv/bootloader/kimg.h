@@ -0,0 +1,25 @@
+// Format of a compressed kernel image (built by "measure pack")
+//
+// [ kimghdr | kimgseg[nseg] | LZ4 block per segment ... ]
+//
+// Each segment is one PT_LOAD segment of the original ELF kernel whose
+// filesz bytes were compressed as a single LZ4 block.
+
+#define KIMG_MAGIC 0x474D494BU  // "KIMG" in little endian
+
+// File header
+struct kimghdr {
+  uint magic;  // must equal KIMG_MAGIC
+  uint nseg;
+  uint64 entry;
+  uint64 size;  // bytes in the whole image, as measured
+};
+
+// Segment header
+struct kimgseg {
+  uint64 paddr;
+  uint64 filesz;  // bytes after decompression
+  uint64 memsz;
+  uint64 off;     // offset of the LZ4 block in the image
+  uint64 csize;   // bytes of the LZ4 block
+};
@@ -0,0 +1,75 @@
+#include "types.h"
+#include "param.h"
+#include "defs.h"
+
+/* CSE 536: Decoder for the LZ4 block format, used to expand compressed
+ * kernel segments directly to their load addresses.
+ *
+ * Each sequence is a token (literal length << 4 | match length - 4),
+ * optional extra length bytes, the literals, a 2-byte little-endian
+ * match offset and optional extra match length bytes. The last
+ * sequence carries literals only.
+ *
+ * Returns the number of bytes written to dst, or -1 if src is malformed
+ * or would overrun dst. */
+int lz4_decompress(const uchar *src, uint64 srclen, uchar *dst, uint64 dstlen)
+{
+  const uchar *ip = src, *iend = src + srclen;
+  uchar *op = dst, *oend = dst + dstlen;
+
+  while (ip < iend) {
+    uint token = *ip++;
+    uint64 len = token >> 4;
+    uint b;
+
+    /* literals */
+    if (len == 15) {
+      do {
+        if (ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+    if (len > (uint64)(iend - ip) || len > (uint64)(oend - op))
+      return -1;
+    memmove(op, ip, len);
+    ip += len;
+    op += len;
+    if (ip == iend)
+      break;
+
+    /* match */
+    if (iend - ip < 2)
+      return -1;
+    uint64 offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (uint64)(op - dst))
+      return -1;
+
+    len = token & 15;
+    if (len == 15) {
+      do {
+        if (ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+    len += 4;
+    if (len > (uint64)(oend - op))
+      return -1;
+
+    const uchar *match = op - offset;
+    if (offset >= len) {
+      memmove(op, match, len);
+      op += len;
+    } else {
+      /* overlapping copy repeats the last offset bytes */
+      while (len-- > 0)
+        *op++ = *match++;
+    }
+  }
+
+  return op - dst;
+}
@@ -0,0 +1,105 @@
+#include "types.h"
+#include "param.h"
+#include "layout.h"
+#include "riscv.h"
+#include "defs.h"
+
+/* CSE 536: Parallel measurement of the NORMAL kernel.
+ *
+ * The image is split into MERKLE_CHUNK-byte chunks. Every hart claims
+ * chunks from a shared counter, loads them and records each chunk's
+ * SHA-256 as a leaf. The measurement is the SHA-256 over all leaves in
+ * chunk order, so verification takes roughly size/NCPU. The same root
+ * is computed by "measure merkle" for generate-measurements. */
+struct {
+  volatile uint64 ready;   // boot_gen of the job published below
+  enum kernel ktype;
+  int measure;             // hash chunks, or only load them
+  uint64 size;
+  uint64 nchunks;
+  volatile uint64 next;    // next unclaimed chunk
+  volatile uint64 done;    // chunks fully hashed
+  BYTE leaf[MERKLE_MAXCHUNK][SHA256_BLOCK_SIZE];
+} merkle;
+
+/* Called by hart 0 before anything else, since RAM (and a job from the
+ * previous boot) survives a warm reset. */
+void merkle_reset(void)
+{
+  merkle.ready = 0;
+  merkle.nchunks = 0;
+  merkle.next = 0;
+  merkle.done = 0;
+  __sync_synchronize();
+}
+
+/* Called by hart 0. Returns -1, after publishing an empty job so the
+ * other harts move on, if the image may not be loaded at all or has
+ * more chunks than there are leaves. */
+int merkle_begin(enum kernel ktype, int measure)
+{
+  int ok = kernel_check(ktype) &&
+    find_kernel_size(ktype) <= (uint64)MERKLE_CHUNK * MERKLE_MAXCHUNK;
+
+  merkle.ktype = ktype;
+  merkle.measure = measure;
+  merkle.size = ok ? find_kernel_size(ktype) : 0;
+  merkle.nchunks = (merkle.size + MERKLE_CHUNK - 1) / MERKLE_CHUNK;
+  merkle.next = 0;
+  merkle.done = 0;
+
+  __sync_synchronize();
+  merkle.ready = boot_gen;
+  return ok ? 0 : -1;
+}
+
+/* Called by every hart: load (and hash) chunks until none are left. */
+void merkle_work(void)
+{
+  SHA256_CTX ctx;
+
+  while (merkle.ready != boot_gen)
+    ;
+  __sync_synchronize();
+
+  for (;;) {
+    uint64 c = __sync_fetch_and_add(&merkle.next, 1);
+    if (c >= merkle.nchunks)
+      break;
+
+    uint64 lo = c * MERKLE_CHUNK;
+    uint64 hi = lo + MERKLE_CHUNK;
+    if (hi > merkle.size)
+      hi = merkle.size;
+
+    if (merkle.measure) {
+      sha256_init(&ctx);
+      kernel_load_range(merkle.ktype, lo, hi, &ctx);
+      sha256_final(&ctx, merkle.leaf[c]);
+    } else {
+      kernel_load_range(merkle.ktype, lo, hi, 0);
+    }
+
+    __sync_fetch_and_add(&merkle.done, 1);
+  }
+}
+
+/* Called by hart 0: wait until every chunk has been loaded. */
+void merkle_wait(void)
+{
+  while (merkle.done < merkle.nchunks)
+    ;
+  __sync_synchronize();
+}
+
+/* Called by hart 0: wait for all leaves and combine them into the root. */
+void merkle_root(BYTE root[SHA256_BLOCK_SIZE])
+{
+  SHA256_CTX ctx;
+
+  merkle_wait();
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, (const BYTE *)merkle.leaf, merkle.nchunks * SHA256_BLOCK_SIZE);
+  sha256_final(&ctx, root);
+}
@@ -12,3 +12,7 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define MERKLE_CHUNK 16384   // bytes hashed per leaf of the kernel measurement
+#define MERKLE_MAXCHUNK 320  // max leaves (covers the 5 MB NORMAL kernel slot)
+#define BOOTCACHE_FULL 8     // warm boots between full re-hashes of the kernel
+#define BOOTCACHE_STRIDE 16  // sample one block in this many for the fingerprint
@@ -0,0 +1,107 @@
+#include "types.h"
+#include "param.h"
+#include "layout.h"
+#include "riscv.h"
+#include "defs.h"
+
+/* CSE 536: Table-driven PMP setup.
+ *
+ * A layout is a list of regions that S-mode may access, in priority
+ * order; everything else is denied once any entry is active. A region
+ * whose only permission is PMP_L is an isolated one: it gets a locked
+ * entry granting nothing, so not even M-mode can touch it or reprogram
+ * that entry until the next reset. The planner
+ * merges adjacent regions with equal permissions, encodes each region
+ * as NAPOT when it is a naturally aligned power of two (NA4 for 4 bytes)
+ * and as TOR otherwise. A TOR region reuses the previous entry as its
+ * base when possible and only spends an extra OFF entry when it cannot. */
+
+/* Returns the number of entries used, or -1 if the layout needs more
+ * than NPMP entries or is not 4-byte aligned. */
+int pmp_plan(const struct pmp_region *r, int n, uint64 *addr, uint8 *cfg)
+{
+  int e = 0;
+
+  for (int i = 0; i < n; i++) {
+    uint64 base = r[i].base;
+    uint64 size = r[i].size;
+
+    /* merge with following regions that continue this one */
+    while (i + 1 < n && r[i + 1].base == base + size && r[i + 1].perm == r[i].perm)
+      size += r[++i].size;
+
+    if ((base | size) & 3)
+      return -1;
+
+    if (size >= 4 && (size & (size - 1)) == 0 && (base & (size - 1)) == 0) {
+      if (e == NPMP)
+        return -1;
+      addr[e] = (base + size / 2 - 1) >> 2;
+      cfg[e] = r[i].perm | (size == 4 ? PMP_A_NA4 : PMP_A_NAPOT);
+      e++;
+      continue;
+    }
+
+    /* TOR takes its base from the previous pmpaddr (0 for entry 0) */
+    uint64 prev = e > 0 ? addr[e - 1] << 2 : 0;
+    if (prev != base) {
+      if (e == NPMP)
+        return -1;
+      addr[e] = base >> 2;
+      cfg[e] = 0;
+      e++;
+    }
+    if (e == NPMP)
+      return -1;
+    addr[e] = (base + size) >> 2;
+    cfg[e] = r[i].perm | PMP_A_TOR;
+    e++;
+  }
+
+  return e;
+}
+
+static void w_pmpaddr(int i, uint64 x)
+{
+  switch (i) {
+  case 0: w_pmpaddr0(x); break;
+  case 1: w_pmpaddr1(x); break;
+  case 2: w_pmpaddr2(x); break;
+  case 3: w_pmpaddr3(x); break;
+  case 4: w_pmpaddr4(x); break;
+  case 5: w_pmpaddr5(x); break;
+  case 6: w_pmpaddr6(x); break;
+  case 7: w_pmpaddr7(x); break;
+  case 8: w_pmpaddr8(x); break;
+  case 9: w_pmpaddr9(x); break;
+  case 10: w_pmpaddr10(x); break;
+  case 11: w_pmpaddr11(x); break;
+  case 12: w_pmpaddr12(x); break;
+  case 13: w_pmpaddr13(x); break;
+  case 14: w_pmpaddr14(x); break;
+  case 15: w_pmpaddr15(x); break;
+  }
+}
+
+/* Plan a layout and program this hart's PMP with it. Entries the layout
+ * does not need are left OFF for the kernel. */
+void pmp_setup(const struct pmp_region *r, int n)
+{
+  uint64 addr[NPMP];
+  uint8 cfg[NPMP];
+  uint64 cfg0 = 0, cfg2 = 0;
+  int used = pmp_plan(r, n, addr, cfg);
+
+  if (used < 0)
+    panic("pmp: layout does not fit");
+
+  for (int i = 0; i < used; i++) {
+    w_pmpaddr(i, addr[i]);
+    if (i < 8)
+      cfg0 |= (uint64)cfg[i] << (8 * i);
+    else
+      cfg2 |= (uint64)cfg[i] << (8 * (i - 8));
+  }
+  w_pmpcfg2(cfg2);
+  w_pmpcfg0(cfg0);
+}
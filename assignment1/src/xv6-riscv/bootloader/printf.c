@@ -0,0 +1,108 @@
+//
+// formatted console output for boot diagnostics, written straight to
+// the UART by polling (the kernel sets the UART up again later).
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "layout.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define Reg(reg) ((volatile unsigned char *)(UART0 + reg))
+#define THR 0                 // transmit holding register (for output bytes)
+#define LSR 5                 // line status register
+#define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
+
+static char digits[] = "0123456789abcdef";
+
+static void
+uartputc(int c)
+{
+  // wait for Transmit Holding Empty to be set in LSR.
+  while((*Reg(LSR) & LSR_TX_IDLE) == 0)
+    ;
+  *Reg(THR) = c;
+}
+
+static void
+printint(long xx, int base, int sign)
+{
+  char buf[24];
+  int i;
+  uint64 x;
+
+  if(sign && (sign = xx < 0))
+    x = -xx;
+  else
+    x = xx;
+
+  i = 0;
+  do {
+    buf[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(sign)
+    buf[i++] = '-';
+
+  while(--i >= 0)
+    uartputc(buf[i]);
+}
+
+// Print to the console. only understands %d, %x, %ld, %lu, %lx, %s.
+// Only hart 0 prints, so there is no lock.
+void
+printf(char *fmt, ...)
+{
+  va_list ap;
+  int i, c;
+  char *s;
+
+  va_start(ap, fmt);
+  for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
+    if(c != '%'){
+      uartputc(c);
+      continue;
+    }
+    c = fmt[++i] & 0xff;
+    if(c == 0)
+      break;
+    if(c == 'l'){
+      c = fmt[++i] & 0xff;
+      if(c == 0)
+        break;
+      if(c == 'd')
+        printint(va_arg(ap, long), 10, 1);
+      else if(c == 'u')
+        printint(va_arg(ap, uint64), 10, 0);
+      else if(c == 'x')
+        printint(va_arg(ap, uint64), 16, 0);
+      continue;
+    }
+    switch(c){
+    case 'd':
+      printint(va_arg(ap, int), 10, 1);
+      break;
+    case 'x':
+      printint(va_arg(ap, uint), 16, 0);
+      break;
+    case 's':
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      for(; *s; s++)
+        uartputc(*s);
+      break;
+    case '%':
+      uartputc('%');
+      break;
+    default:
+      // Print unknown % sequence to draw attention.
+      uartputc('%');
+      uartputc(c);
+      break;
+    }
+  }
+  va_end(ap);
+}
@@ -9,6 +9,17 @@ r_mhartid()
   return x;
 }
 
+// Machine ISA Register, misa
+#define MISA_EXT(c) (1L << ((c) - 'A'))  // single-letter extension bit
+
+static inline uint64
+r_misa()
+{
+  uint64 x;
+  asm volatile("csrr %0, misa" : "=r" (x) );
+  return x;
+}
+
 // Machine Status Register, mstatus
 
 #define MSTATUS_MPP_MASK (3L << 11) // previous mode.
@@ -184,6 +195,15 @@ w_mtvec(uint64 x)
 }
 
 // Physical Memory Protection
+#define NPMP 16                // pmpaddr0-15, configured by pmpcfg0/pmpcfg2
+#define PMP_R (1L << 0)
+#define PMP_W (1L << 1)
+#define PMP_X (1L << 2)
+#define PMP_A_TOR (1L << 3)    // top of range, base is the previous pmpaddr
+#define PMP_A_NA4 (2L << 3)    // naturally aligned 4-byte region
+#define PMP_A_NAPOT (3L << 3)  // naturally aligned power-of-two region
+#define PMP_L (1L << 7)        // locked, and enforced in M-mode too
+
 static inline void
 w_pmpcfg0(uint64 x)
 {
@@ -221,6 +241,78 @@ w_pmpaddr4(uint64 x)
   asm volatile("csrw pmpaddr4, %0" : : "r" (x));
 }
 
+static inline void
+w_pmpaddr5(uint64 x)
+{
+  asm volatile("csrw pmpaddr5, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr6(uint64 x)
+{
+  asm volatile("csrw pmpaddr6, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr7(uint64 x)
+{
+  asm volatile("csrw pmpaddr7, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr8(uint64 x)
+{
+  asm volatile("csrw pmpaddr8, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr9(uint64 x)
+{
+  asm volatile("csrw pmpaddr9, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr10(uint64 x)
+{
+  asm volatile("csrw pmpaddr10, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr11(uint64 x)
+{
+  asm volatile("csrw pmpaddr11, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr12(uint64 x)
+{
+  asm volatile("csrw pmpaddr12, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr13(uint64 x)
+{
+  asm volatile("csrw pmpaddr13, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr14(uint64 x)
+{
+  asm volatile("csrw pmpaddr14, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpaddr15(uint64 x)
+{
+  asm volatile("csrw pmpaddr15, %0" : : "r" (x));
+}
+
+static inline void
+w_pmpcfg2(uint64 x)
+{
+  asm volatile("csrw pmpcfg2, %0" : : "r" (x));
+}
+
 // use riscv's sv39 page table scheme.
 #define SATP_SV39 (8L << 60)
 
@@ -282,6 +374,14 @@ r_mcounteren()
 }
 
 // machine-mode cycle counter
+static inline uint64
+r_mcycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, mcycle" : "=r" (x) );
+  return x;
+}
+
 static inline uint64
 r_time()
 {
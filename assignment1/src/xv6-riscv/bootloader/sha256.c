@@ -44,46 +44,104 @@ static const WORD k[64] = {
 	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
+// Big-endian load of a 4-byte aligned message word.
+#define LOAD_BE32(p) ({ WORD __w = *(const WORD *)(p); \
+	(__w >> 24) | ((__w >> 8) & 0x0000ff00) | ((__w << 8) & 0x00ff0000) | (__w << 24); })
+
+// Message schedule kept in a 16-word ring, expanded as the rounds need it.
+#define W(i) ((i) < 16 ? (m[(i) & 15] = LOAD_BE32(data + 4 * (i))) : \
+	(m[(i) & 15] += SIG1(m[((i) - 2) & 15]) + m[((i) - 7) & 15] + SIG0(m[((i) - 15) & 15])))
+
+// One round; callers rotate the argument names instead of the registers.
+#define RND(a,b,c,d,e,f,g,h,i) do { \
+	WORD t1 = h + EP1(e) + CH(e,f,g) + k[i] + W(i); \
+	d += t1; \
+	h = t1 + EP0(a) + MAJ(a,b,c); \
+} while (0)
+
+#define RND8(i) \
+	RND(a,b,c,d,e,f,g,h,(i)+0); RND(h,a,b,c,d,e,f,g,(i)+1); \
+	RND(g,h,a,b,c,d,e,f,(i)+2); RND(f,g,h,a,b,c,d,e,(i)+3); \
+	RND(e,f,g,h,a,b,c,d,(i)+4); RND(d,e,f,g,h,a,b,c,(i)+5); \
+	RND(c,d,e,f,g,h,a,b,(i)+6); RND(b,c,d,e,f,g,h,a,(i)+7)
+
+// Body shared by every transform variant. EP0/EP1/SIG0/SIG1 and LOAD_BE32
+// are expanded where this is used, so each variant may redefine them.
+#define SHA256_TRANSFORM_BODY \
+	WORD a, b, c, d, e, f, g, h, m[16]; \
+	a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3]; \
+	e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7]; \
+	RND8(0); RND8(8); RND8(16); RND8(24); RND8(32); RND8(40); RND8(48); RND8(56); \
+	ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d; \
+	ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h
+
 /*********************** FUNCTION DEFINITIONS ***********************/
-void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+// All transforms expect data to be 4-byte aligned; sha256_update() ensures it.
+static void sha256_transform_generic(SHA256_CTX *ctx, const BYTE data[])
 {
-	WORD a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
-
-	for (i = 0, j = 0; i < 16; ++i, j += 4)
-		m[i] = (data[j] << 24) | (data[j + 1] << 16) | (data[j + 2] << 8) | (data[j + 3]);
-	for ( ; i < 64; ++i)
-		m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
-
-	a = ctx->state[0];
-	b = ctx->state[1];
-	c = ctx->state[2];
-	d = ctx->state[3];
-	e = ctx->state[4];
-	f = ctx->state[5];
-	g = ctx->state[6];
-	h = ctx->state[7];
-
-	for (i = 0; i < 64; ++i) {
-		t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
-		t2 = EP0(a) + MAJ(a,b,c);
-		h = g;
-		g = f;
-		f = e;
-		e = d + t1;
-		d = c;
-		c = b;
-		b = a;
-		a = t1 + t2;
-	}
+	SHA256_TRANSFORM_BODY;
+}
+
+#if defined(__riscv)
+// The bit-manipulation and scalar crypto instructions are emitted through
+// .insn so the bootloader still assembles with toolchains that lack them.
+
+// Zbb: rotate and byte-reverse in one instruction each.
+#define RORIW(x,n) ({ WORD __r; \
+	asm(".insn i 0x1b, 5, %0, %1, %2" : "=r" (__r) : "r" (x), "i" (0x600 | (n))); __r; })
+#define REV8(x) ({ uint64 __r; \
+	asm(".insn i 0x13, 5, %0, %1, 0x6b8" : "=r" (__r) : "r" (x)); __r; })
 
-	ctx->state[0] += a;
-	ctx->state[1] += b;
-	ctx->state[2] += c;
-	ctx->state[3] += d;
-	ctx->state[4] += e;
-	ctx->state[5] += f;
-	ctx->state[6] += g;
-	ctx->state[7] += h;
+#undef ROTRIGHT
+#undef LOAD_BE32
+#define ROTRIGHT(a,b) RORIW(a,b)
+#define LOAD_BE32(p) ((WORD)(REV8((uint64)*(const WORD *)(p)) >> 32))
+
+static void sha256_transform_zbb(SHA256_CTX *ctx, const BYTE data[])
+{
+	SHA256_TRANSFORM_BODY;
+}
+
+#if defined(SHA256_ZKNH)
+// Zknh: each sigma function is a single instruction. There is no misa bit
+// for Zknh, so this path is only built when the target is known to have it.
+// Message words are loaded with plain shifts, so Zbb is not needed here.
+#define ZKNH(x,f) ({ WORD __r; \
+	asm(".insn i 0x13, 1, %0, %1, %2" : "=r" (__r) : "r" (x), "i" (f)); __r; })
+
+#undef LOAD_BE32
+#define LOAD_BE32(p) ({ WORD __w = *(const WORD *)(p); \
+	(__w >> 24) | ((__w >> 8) & 0x0000ff00) | ((__w << 8) & 0x00ff0000) | (__w << 24); })
+#undef EP0
+#undef EP1
+#undef SIG0
+#undef SIG1
+#define EP0(x) ZKNH(x, 0x100)
+#define EP1(x) ZKNH(x, 0x101)
+#define SIG0(x) ZKNH(x, 0x102)
+#define SIG1(x) ZKNH(x, 0x103)
+
+static void sha256_transform_zknh(SHA256_CTX *ctx, const BYTE data[])
+{
+	SHA256_TRANSFORM_BODY;
+}
+#endif
+#endif
+
+static void (*sha256_transform)(SHA256_CTX *ctx, const BYTE data[]) = sha256_transform_generic;
+
+// Pick the fastest transform the harts support. Called once by hart 0
+// before any hashing starts.
+void sha256_select(void)
+{
+#if defined(__riscv)
+#if defined(SHA256_ZKNH)
+	sha256_transform = sha256_transform_zknh;
+#else
+	if (r_misa() & MISA_EXT('B'))
+		sha256_transform = sha256_transform_zbb;
+#endif
+#endif
 }
 
 void sha256_init(SHA256_CTX *ctx)
@@ -102,17 +160,32 @@ void sha256_init(SHA256_CTX *ctx)
 
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
 {
-	WORD i;
+	size_t i = 0;
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
+	// Top up a partially filled block first.
+	if (ctx->datalen) {
+		while (i < len && ctx->datalen < 64)
+			ctx->data[ctx->datalen++] = data[i++];
+		if (ctx->datalen < 64)
+			return;
+		sha256_transform(ctx, ctx->data);
+		ctx->bitlen += 512;
+		ctx->datalen = 0;
+	}
+
+	// Whole blocks are hashed in place unless they are misaligned.
+	for ( ; len - i >= 64; i += 64) {
+		const BYTE *block = data + i;
+		if ((uint64)block & 3) {
+			memmove(ctx->data, block, 64);
+			block = ctx->data;
 		}
+		sha256_transform(ctx, block);
+		ctx->bitlen += 512;
 	}
+
+	while (i < len)
+		ctx->data[ctx->datalen++] = data[i++];
 }
 
 void sha256_final(SHA256_CTX *ctx, BYTE hash[])
@@ -159,4 +232,51 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 		hash[i + 24] = (ctx->state[6] >> (24 - i * 8)) & 0x000000ff;
 		hash[i + 28] = (ctx->state[7] >> (24 - i * 8)) & 0x000000ff;
 	}
-}
\ No newline at end of file
+}
+#if defined(SHA256_BENCH)
+#define BENCH_ROUNDS 8
+
+// Print the best of BENCH_ROUNDS hashes of len bytes with one transform,
+// in CLINT_MTIME ticks and mcycle cycles.
+static void sha256_bench_one(char *name, void (*transform)(SHA256_CTX *ctx, const BYTE data[]),
+                             const BYTE data[], size_t len)
+{
+	uint64 ticks = ~0UL, cycles = ~0UL;
+	BYTE hash[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+
+	sha256_transform = transform;
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		uint64 t0 = *(volatile uint64 *)CLINT_MTIME;
+		uint64 c0 = r_mcycle();
+		sha256_init(&ctx);
+		sha256_update(&ctx, data, len);
+		sha256_final(&ctx, hash);
+		uint64 c = r_mcycle() - c0;
+		uint64 t = *(volatile uint64 *)CLINT_MTIME - t0;
+		if (t < ticks)
+			ticks = t;
+		if (c < cycles)
+			cycles = c;
+	}
+	printf("sha256 %s: %lu bytes, %lu ticks, %lu cycles (%lu cycles/block)\n",
+	       name, (uint64)len, ticks, cycles, cycles / (len / 64 ? len / 64 : 1));
+}
+
+// Time every transform this hart can run, on the hart itself. The
+// selected transform is left in place afterwards.
+void sha256_bench(const BYTE data[], size_t len)
+{
+	void (*selected)(SHA256_CTX *ctx, const BYTE data[]) = sha256_transform;
+
+	sha256_bench_one("generic", sha256_transform_generic, data, len);
+#if defined(__riscv)
+	if (r_misa() & MISA_EXT('B'))
+		sha256_bench_one("zbb", sha256_transform_zbb, data, len);
+#if defined(SHA256_ZKNH)
+	sha256_bench_one("zknh", sha256_transform_zknh, data, len);
+#endif
+#endif
+	sha256_transform = selected;
+}
+#endif
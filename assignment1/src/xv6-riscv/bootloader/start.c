@@ -15,8 +15,13 @@ void timerinit();
 /* entry.S needs one stack per CPU */
 __attribute__ ((aligned (16))) char bl_stack[STSIZE * NCPU];
 
-/* Context (SHA-256) for secure boot */
-SHA256_CTX sha256_ctx;
+/* Entry point chosen by hart 0; other harts wait until boot_released
+ * holds this boot's generation */
+volatile uint64 boot_entry;
+volatile uint64 boot_released;
+
+/* Generation of the current boot, bumped by hart 0 on every reset */
+volatile uint64 boot_gen;
 
 /* Structure to collects system information */
 struct sys_info {
@@ -29,9 +34,62 @@ struct sys_info {
   /* Kernel SHA-256 hashes */
   BYTE expected_kernel_measurement[32];
   BYTE observed_kernel_measurement[32];
+  /* Boot-phase timestamps taken on hart 0, in CLINT_MTIME ticks and
+   * mcycle cycles, indexed by enum boot_phase */
+  uint64 boot_mtime[BP_NPHASE];
+  uint64 boot_cycle[BP_NPHASE];
+  /* Kernel image bytes hashed and copied into place */
+  uint64 bytes_hashed;
+  uint64 bytes_copied;
 };
 struct sys_info* sys_info_ptr;
 
+/* CSE 536: Record the time at which hart 0 finished a boot phase. */
+static void boot_stamp(enum boot_phase phase)
+{
+  sys_info_ptr->boot_mtime[phase] = *(volatile uint64 *)CLINT_MTIME;
+  sys_info_ptr->boot_cycle[phase] = r_mcycle();
+}
+
+#if defined(BOOTSTATS)
+static char *boot_phase_name[BP_NPHASE] = {
+  "start", "pmp", "elf", "hash", "decide", "copy", "mret",
+};
+
+/* CSE 536: Print how long each boot phase took on hart 0, and how many
+ * kernel bytes were hashed and copied. */
+static void boot_stats(void)
+{
+  for (int i = 1; i < BP_NPHASE; i++)
+    printf("boot: %s %lu ticks %lu cycles\n", boot_phase_name[i],
+           sys_info_ptr->boot_mtime[i] - sys_info_ptr->boot_mtime[i - 1],
+           sys_info_ptr->boot_cycle[i] - sys_info_ptr->boot_cycle[i - 1]);
+  printf("boot: %lu bytes hashed, %lu bytes copied\n",
+         sys_info_ptr->bytes_hashed, sys_info_ptr->bytes_copied);
+}
+#endif
+
+/* CSE 536: Memory S-mode may access for each kernel; anything not
+ * listed is denied, and PMP_L regions are locked out for every mode.
+ * See pmp.c for how these become PMP entries. */
+#define MB (1024 * 1024)
+static const struct pmp_region pmp_layout[] = {
+#if defined(KERNELPMP1)
+  /* isolate the upper 11 MBs (117-128 MB) */
+  { 0, KERNBASE + 117 * MB, PMP_R | PMP_W | PMP_X },
+#elif defined(KERNELPMP2)
+  /* isolate 118-120 MB and 122-126 MB */
+  { 0, KERNBASE + 118 * MB, PMP_R | PMP_W | PMP_X },
+  { KERNBASE + 118 * MB, 2 * MB, PMP_L },
+  { KERNBASE + 120 * MB, 2 * MB, PMP_R | PMP_W | PMP_X },
+  { KERNBASE + 122 * MB, 4 * MB, PMP_L },
+  { KERNBASE + 126 * MB, 2 * MB, PMP_R | PMP_W | PMP_X },
+#else
+  /* allow all memory regions */
+  { 0, 1UL << 56, PMP_R | PMP_W | PMP_X },
+#endif
+};
+
 extern void _entry(void);
 void panic(char *s)
 {
@@ -42,55 +100,72 @@ void panic(char *s)
 /* CSE 536: Boot into the RECOVERY kernel instead of NORMAL kernel
  * when hash verification fails. */
 void setup_recovery_kernel(void) {
+  /* The RECOVERY image is trusted, so it is loaded without measuring */
+  if (!kernel_check(RECOVERY))
+    panic("recovery kernel does not fit");
+  kernel_load(RECOVERY, 0);
+}
 
-  uint64 kernel_load_addr       = find_kernel_load_addr(RECOVERY);
-  uint64 kernel_binary_size     = find_kernel_size(RECOVERY);
-
-  int block_num = (kernel_binary_size+BSIZE-1)/BSIZE;
-  int block_to_skip = 4096/BSIZE;
-  uint64 *load_addr = (uint64 *)kernel_load_addr;
+/* CSE 536: Function verifies if NORMAL kernel is expected or tampered.
+ * The NORMAL kernel is loaded and measured in the same pass (shared with
+ * the other harts), so on success only its BSS is left to clear, or, for
+ * a compressed image, it is expanded now that its bytes are trusted. On
+ * failure whatever was copied is wiped and the RECOVERY kernel is loaded
+ * instead. Runs on hart 0 only. */
+bool is_secure_boot(void) {
+  bool verification = true;
+  bool cached = false;
 
-  struct buf b;
-  b.disk = 1;
+  /* CSE 536: Choose the SHA-256 transform once, before any hashing */
+  sha256_select();
+  #if defined(SHA256_BENCH)
+    if (kernel_check(NORMAL))
+      sha256_bench((const BYTE *)RAMDISK, find_kernel_size(NORMAL));
+  #endif
 
-  for(int i = block_to_skip; i<block_num; i++){
-     b.valid = 0;
-     b.blockno = i;
+  #if defined(BOOTCACHE)
+    /* CSE 536: On a warm reboot, a valid record of this image stands in
+     * for the full hash (the kernel is then only loaded). */
+    cached = bootcache_lookup(NORMAL, trusted_kernel_hash);
+  #endif
 
-     kernel_copy(RECOVERY, &b);
-     if(b.valid == 1){
-        memmove((char *)load_addr + ((i-block_to_skip)*BSIZE), b.data, BSIZE);
-     }
+  /* CSE 536: An image whose headers would place it outside the kernel
+   * slot is rejected before any of it is copied. */
+  bool loadable = (merkle_begin(NORMAL, !cached) == 0);
+  boot_stamp(BP_ELF);
+  merkle_work();
+  if (!loadable) {
+    memset(sys_info_ptr->observed_kernel_measurement, 0, 32);
+  } else if (cached) {
+    merkle_wait();
+    memmove(sys_info_ptr->observed_kernel_measurement, trusted_kernel_hash, 32);
+  } else {
+    merkle_root(sys_info_ptr->observed_kernel_measurement);
   }
-  uint64 kernel_entry = find_kernel_entry_addr(RECOVERY);
-  w_mepc(kernel_entry);
-
-}
+  boot_stamp(BP_HASH);
+
+  memmove(sys_info_ptr->expected_kernel_measurement, trusted_kernel_hash, 32);
+  verification = loadable &&
+    (memcmp(sys_info_ptr->observed_kernel_measurement, trusted_kernel_hash, 32)==0);
+  boot_stamp(BP_DECIDE);
+
+  #if defined(BOOTCACHE)
+    if (!verification)
+      bootcache_clear();
+    else if (!cached)
+      bootcache_save(NORMAL, sys_info_ptr->observed_kernel_measurement);
+    bootcache_forget_key();
+  #endif
 
-/* CSE 536: Function verifies if NORMAL kernel is expected or tampered. */
-bool is_secure_boot(void) {
-  bool verification = true;
-   
-  /* Read the binary and update the observed measurement 
-   * (simplified template provided below) */
- 
-  sha256_init(&sha256_ctx);
- 
-  uint64 kernel_size = find_kernel_size(NORMAL);
-  
-  sha256_update(&sha256_ctx, (const BYTE*) RAMDISK, kernel_size);
-    
-  sha256_final(&sha256_ctx, sys_info_ptr->observed_kernel_measurement);
-  memmove(sys_info_ptr->expected_kernel_measurement, trusted_kernel_hash, 32);  
-  verification = (memcmp(sys_info_ptr->observed_kernel_measurement, trusted_kernel_hash, 32)==0);
-
-  /* Three more tasks required below: 
-   *  1. Compare observed measurement with expected hash
-   *  2. Setup the recovery kernel if comparison fails
-   *  3. Copy expected kernel hash to the system information table */
-  if (!verification)
+  if (verification) {
+    __sync_fetch_and_add(&bytes_copied, kernel_finish_load(NORMAL));
+  } else {
+    if (loadable)
+      kernel_unload(NORMAL);
     setup_recovery_kernel();
-  
+  }
+  boot_stamp(BP_COPY);
+
   return verification;
 }
 
@@ -104,6 +179,28 @@ void start()
   int id = r_mhartid();
   w_tp(id);
 
+  /* CSE 536: RAM survives a warm reset, so hart 0 clears the handshake
+   * state the previous boot left behind and starts a new generation.
+   * Only then does it wake the other harts with a software interrupt:
+   * the CLINT, unlike RAM, is cleared by every reset, so no hart can act
+   * on a stale job or entry point from the previous boot. */
+  if (id == 0) {
+    boot_stamp(BP_START);
+    merkle_reset();
+    boot_entry = 0;
+    boot_released = 0;
+    if (++boot_gen == 0)  // 0 means "nothing published"
+      boot_gen = 1;
+    __sync_synchronize();
+    for (int i = 1; i < NCPU; i++)
+      *(volatile uint32 *)CLINT_MSIP(i) = 1;
+  } else {
+    while (*(volatile uint32 *)CLINT_MSIP(id) == 0)
+      ;
+    *(volatile uint32 *)CLINT_MSIP(id) = 0;
+    __sync_synchronize();
+  }
+
   // set M Previous Privilege mode to Supervisor, for mret.
   unsigned long x = r_mstatus();
   x &= ~MSTATUS_MPP_MASK;
@@ -113,77 +210,35 @@ void start()
   // disable paging
   w_satp(0);
 
-  /* CSE 536: Unless kernelpmp[1-2] booted, allow all memory 
-   * regions to be accessed in S-mode. */ 
-  #if !defined(KERNELPMP1) || !defined(KERNELPMP2)
-    w_pmpaddr0(0x3fffffffffffffull);
-    w_pmpcfg0(0xf);
-  #endif
-  uint64 bootloader_start = 0x80000000;
-  uint64 top_addr = bootloader_start + (117*BSIZE*BSIZE);
-  top_addr = top_addr >> 2;
-
-    /* CSE 536: With kernelpmp1, isolate upper 10MBs using TOR */ 
-  #if defined(KERNELPMP1)
-    uint64 pmpcfg0_val = 1<<0 | 1<<1 | 1<<2 | 1<<3;
-
-    w_pmpaddr0(top_addr);
-    w_pmpcfg0(pmpcfg0_val);
-  #endif
-  /* CSE 536: With kernelpmp2, isolate 118-120 MB and 122-126 MB using NAPOT */ 
-  #if defined(KERNELPMP2)
-    uint64 tor_addr = 0x80000000 + ((118*BSIZE*BSIZE)-1);
-    tor_addr = tor_addr >> 2;
-    w_pmpaddr0(tor_addr);//0-118 MB
-    w_pmpaddr1(0x21DBFFFF);//118-120 MB
-
-    w_pmpaddr2(0x21E3FFFF);//120-122 MBB
- 
-    w_pmpaddr3(0x21EFFFFF);//122-126 MB
-    w_pmpaddr4(0x21FBFFFF);
-
-    uint64 pmpcfg_val = (1<<0 | 1<<1 | 1<<2 | 1<<3 ) | ((uint64)0x83 << 8) | ((uint64)0x1f << 16) | ((uint64)0x83 << 24) | ((uint64)0x1f << 32);
-    
-    w_pmpcfg0(pmpcfg_val);
-
-
-  #endif
-  uint64  kernel_load_addr = find_kernel_load_addr(NORMAL);  
- /* CSE 536: Verify if the kernel is untampered for ecure boot */
-  if (!is_secure_boot()) {
-     
-    goto out;
-  }
-  
-  /* CSE 536: Load the NORMAL kernel binary (assuming secure boot passed). */
-  uint64 kernel_binary_size     = find_kernel_size(NORMAL);
- 
-  int block_num = (kernel_binary_size+BSIZE-1)/BSIZE; 
-  int block_to_skip = 4096/BSIZE;
-  uint64 *load_addr = (uint64 *)kernel_load_addr;
-
-  struct buf b;
-  b.disk = 1;
-
-  for(int i = block_to_skip; i<block_num; i++){
-     b.valid = 0;
-     b.blockno = i;
-
-     kernel_copy(NORMAL, &b);
-     if(b.valid == 1){
-        memmove((char *)load_addr + ((i-block_to_skip)*BSIZE), b.data, BSIZE);
-     }
+  /* CSE 536: Program this hart's PMP from the layout for this kernel */
+  pmp_setup(pmp_layout, NELEM(pmp_layout));
+  if (id == 0)
+    boot_stamp(BP_PMP);
+
+  /* CSE 536: Every hart helps load and measure the NORMAL kernel. Hart 0
+   * verifies it for secure boot (falling back to RECOVERY) and then
+   * releases the other harts into whichever kernel it chose. */
+  if (id == 0) {
+    uint64 kernel_entry;
+    if (is_secure_boot())
+      kernel_entry = find_kernel_entry_addr(NORMAL);
+    else
+      kernel_entry = find_kernel_entry_addr(RECOVERY);
+    sys_info_ptr->bytes_hashed = bytes_hashed;
+    sys_info_ptr->bytes_copied = bytes_copied;
+    boot_entry = kernel_entry;
+    __sync_synchronize();
+    boot_released = boot_gen;
+  } else {
+    merkle_work();
+    while (boot_released != boot_gen)
+      ;
+    __sync_synchronize();
   }
-  
 
-  uint64 kernel_entry = find_kernel_entry_addr(NORMAL);
-  
   /* CSE 536: Write the correct kernel entry point */
-  w_mepc( kernel_entry);
+  w_mepc(boot_entry);
 
-  //extern uint64 end;
- 
-out:
   /* CSE 536: Provide system information to the kernel. */
   sys_info_ptr = (struct sys_info*) 0x80080000;
   sys_info_ptr->bl_start = 0x80000000;
@@ -197,6 +252,13 @@ out:
   w_mideleg(0xffff);
   w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
+  if (id == 0) {
+    boot_stamp(BP_MRET);
+    #if defined(BOOTSTATS)
+      boot_stats();
+    #endif
+  }
+
   // return address fix
   uint64 addr = (uint64) panic;
   asm volatile("mv ra, %0" : : "r" (addr));
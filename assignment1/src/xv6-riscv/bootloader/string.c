@@ -4,10 +4,17 @@ void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w = (uchar)c * 0x0101010101010101UL;
+
+  // byte stores up to an 8-byte boundary, then whole words
+  while(n > 0 && ((uint64)cdst & 7)){
+    *cdst++ = c;
+    n--;
   }
+  for(; n >= 8; n -= 8, cdst += 8)
+    *(uint64 *)cdst = w;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -43,9 +50,19 @@ memmove(void *dst, const void *src, uint n)
     d += n;
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    // copy whole words when both sides can reach the same alignment
+    if((((uint64)s ^ (uint64)d) & 7) == 0){
+      while(n > 0 && ((uint64)d & 7)){
+        *d++ = *s++;
+        n--;
+      }
+      for(; n >= 8; n -= 8, s += 8, d += 8)
+        *(uint64 *)d = *(const uint64 *)s;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -0,0 +1,241 @@
+// Host-side companion to the bootloader's secure-boot measurement code.
+// It links the bootloader's own sha256.c so it measures exactly what the
+// bootloader measures.
+//
+//   measure merkle <kernel>     print the kernel's Merkle root (hex)
+//   measure pack <elf> <out>    write an LZ4-compressed kernel image
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bootloader/types.h"
+#include "bootloader/param.h"
+#include "bootloader/sha256.h"
+#include "bootloader/elf.h"
+#include "bootloader/kimg.h"
+
+int lz4_decompress(const uchar *src, uint64 srclen, uchar *dst, uint64 dstlen);
+
+static BYTE*
+readfile(const char *path, uint64 *size)
+{
+  FILE *f;
+  BYTE *buf;
+  long n;
+
+  if((f = fopen(path, "rb")) == 0){
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if((buf = malloc(n ? n : 1)) == 0 || fread(buf, 1, n, f) != n){
+    fprintf(stderr, "%s: read failed\n", path);
+    exit(1);
+  }
+  fclose(f);
+  *size = n;
+  return buf;
+}
+
+static void
+printhash(BYTE hash[SHA256_BLOCK_SIZE])
+{
+  for(int i = 0; i < SHA256_BLOCK_SIZE; i++)
+    printf("%02x", hash[i]);
+}
+
+// Same construction as bootloader/merkle.c: SHA-256 of each
+// MERKLE_CHUNK-byte chunk, then SHA-256 over those leaves in order.
+static void
+merkle_root(BYTE *buf, uint64 size, BYTE root[SHA256_BLOCK_SIZE])
+{
+  uint64 nchunks = (size + MERKLE_CHUNK - 1) / MERKLE_CHUNK;
+  BYTE leaf[SHA256_BLOCK_SIZE];
+  SHA256_CTX ctx, rootctx;
+
+  if(nchunks > MERKLE_MAXCHUNK){
+    fprintf(stderr, "merkle: image has %lu chunks, max %d\n", nchunks, MERKLE_MAXCHUNK);
+    exit(1);
+  }
+
+  sha256_init(&rootctx);
+  for(uint64 lo = 0; lo < size; lo += MERKLE_CHUNK){
+    uint64 n = size - lo < MERKLE_CHUNK ? size - lo : MERKLE_CHUNK;
+    sha256_init(&ctx);
+    sha256_update(&ctx, buf + lo, n);
+    sha256_final(&ctx, leaf);
+    sha256_update(&rootctx, leaf, SHA256_BLOCK_SIZE);
+  }
+  sha256_final(&rootctx, root);
+}
+
+static int
+merkle(char *path)
+{
+  uint64 size;
+  BYTE *buf = readfile(path, &size);
+  BYTE root[SHA256_BLOCK_SIZE];
+
+  merkle_root(buf, size, root);
+  printhash(root);
+  printf("\n");
+  free(buf);
+  return 0;
+}
+
+// Emit an LZ4 length: 15 in the token nibble, then 255s and a remainder.
+static BYTE*
+lz4_len(BYTE *op, uint64 len)
+{
+  for(len -= 15; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+static BYTE*
+lz4_sequence(BYTE *op, const BYTE *lit, uint64 nlit, uint64 offset, uint64 mlen)
+{
+  BYTE *token = op++;
+
+  *token = (nlit < 15 ? nlit : 15) << 4;
+  if(nlit >= 15)
+    op = lz4_len(op, nlit);
+  memcpy(op, lit, nlit);
+  op += nlit;
+  if(mlen == 0)
+    return op;
+
+  *op++ = offset;
+  *op++ = offset >> 8;
+  mlen -= 4;
+  *token |= mlen < 15 ? mlen : 15;
+  if(mlen >= 15)
+    op = lz4_len(op, mlen);
+  return op;
+}
+
+static uint32
+read32(const BYTE *p)
+{
+  uint32 x;
+  memcpy(&x, p, 4);
+  return x;
+}
+
+// Greedy LZ4 block compressor with a 4-byte hash table. Follows the
+// format's end rules: the last match starts at least 12 bytes before
+// the end and the last 5 bytes are always literals.
+static uint64
+lz4_compress(const BYTE *src, uint64 n, BYTE *dst)
+{
+  static uint64 table[1 << 16];  // last position + 1 for each hash
+  uint64 ip = 0, anchor = 0;
+  BYTE *op = dst;
+
+  memset(table, 0, sizeof(table));
+  while(n >= 12 && ip < n - 12){
+    uint32 seq = read32(src + ip);
+    uint32 h = (seq * 2654435761u) >> 16;
+    uint64 cand = table[h];
+
+    table[h] = ip + 1;
+    if(cand == 0 || ip - (cand - 1) > 65535 || read32(src + cand - 1) != seq){
+      ip++;
+      continue;
+    }
+    cand--;
+
+    uint64 mlen = 4;
+    while(ip + mlen < n - 5 && src[cand + mlen] == src[ip + mlen])
+      mlen++;
+    op = lz4_sequence(op, src + anchor, ip - anchor, ip - cand, mlen);
+    ip += mlen;
+    anchor = ip;
+  }
+  op = lz4_sequence(op, src + anchor, n - anchor, 0, 0);
+  return op - dst;
+}
+
+// Pack every PT_LOAD segment of an ELF kernel into a kimg image, then
+// expand it again to check the result before writing it out.
+static int
+pack(char *in, char *out)
+{
+  uint64 size, off;
+  BYTE *elfbuf = readfile(in, &size);
+  struct elfhdr *elf = (struct elfhdr *)elfbuf;
+  struct kimghdr hdr;
+  struct kimgseg seg[16];
+  BYTE *payload[16];
+  FILE *f;
+
+  if(size < sizeof(*elf) || elf->magic != ELF_MAGIC){
+    fprintf(stderr, "%s: not an ELF file\n", in);
+    return 1;
+  }
+
+  hdr.magic = KIMG_MAGIC;
+  hdr.nseg = 0;
+  hdr.entry = elf->entry;
+  for(int i = 0; i < elf->phnum; i++){
+    struct proghdr *ph = (struct proghdr *)(elfbuf + elf->phoff + i * elf->phentsize);
+    if(ph->type != ELF_PROG_LOAD)
+      continue;
+    if(hdr.nseg == sizeof(seg) / sizeof(seg[0])){
+      fprintf(stderr, "%s: too many segments\n", in);
+      return 1;
+    }
+
+    struct kimgseg *s = &seg[hdr.nseg];
+    BYTE *check = malloc(ph->filesz + 1);
+    s->paddr = ph->paddr;
+    s->filesz = ph->filesz;
+    s->memsz = ph->memsz;
+    payload[hdr.nseg] = malloc(ph->filesz + ph->filesz / 255 + 16);
+    s->csize = lz4_compress(elfbuf + ph->off, ph->filesz, payload[hdr.nseg]);
+    if(lz4_decompress(payload[hdr.nseg], s->csize, check, ph->filesz) != ph->filesz ||
+       memcmp(check, elfbuf + ph->off, ph->filesz) != 0){
+      fprintf(stderr, "%s: segment %d does not round-trip\n", in, i);
+      return 1;
+    }
+    free(check);
+    hdr.nseg++;
+  }
+
+  off = sizeof(hdr) + hdr.nseg * sizeof(struct kimgseg);
+  for(int i = 0; i < hdr.nseg; i++){
+    seg[i].off = off;
+    off += seg[i].csize;
+  }
+  hdr.size = off;
+
+  if((f = fopen(out, "wb")) == 0){
+    perror(out);
+    return 1;
+  }
+  fwrite(&hdr, sizeof(hdr), 1, f);
+  fwrite(seg, sizeof(struct kimgseg), hdr.nseg, f);
+  for(int i = 0; i < hdr.nseg; i++)
+    fwrite(payload[i], 1, seg[i].csize, f);
+  fclose(f);
+
+  printf("%s: %lu -> %lu bytes\n", out, size, hdr.size);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 3 && strcmp(argv[1], "merkle") == 0)
+    return merkle(argv[2]);
+  if(argc == 4 && strcmp(argv[1], "pack") == 0)
+    return pack(argv[2], argv[3]);
+
+  fprintf(stderr, "Usage: measure merkle <kernel>\n");
+  fprintf(stderr, "       measure pack <elf> <out>\n");
+  return 1;
+}
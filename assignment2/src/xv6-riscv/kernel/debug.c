@@ -20,6 +20,12 @@ void print_skip_section(char* name, uint64 vaddr, int size) {
         name, vaddr, size);
 }
 
+void print_skip_heap_region(char* name, uint64 vaddr, int npages) {
+    printf("Skipping heap region allocation (proc: %s, addr: %x, npages: %d)\n", 
+        name, vaddr, npages);
+}
+
+#ifdef PFTRACE
 void print_page_fault(char* name, uint64 vaddr) {
     printf("----------------------------------------\n");
     printf("#PF: Proc (%s), Page (%x)\n", name, vaddr);
@@ -37,11 +43,7 @@ void print_load_seg(uint64 vaddr, uint64 seg, int size) {
     printf("LOAD: Addr (%x), SEG: (%x), SIZE (%d)\n", vaddr, seg, size);
 }
 
-void print_skip_heap_region(char* name, uint64 vaddr, int npages) {
-    printf("Skipping heap region allocation (proc: %s, addr: %x, npages: %d)\n", 
-        name, vaddr, npages);
-}
-
 void print_copy_on_write(struct proc *p, uint64 vaddr) {
     printf("CoW: proc(%s)[%d] Addr (%x)\n", p->name, p->pid, vaddr);
-}
\ No newline at end of file
+}
+#endif
@@ -8,19 +8,12 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vmstats;
 
 
 //cow.c
-void    	decr_cow_group_count(int group);
-int 		get_cow_group_count(int group);
-void 		incr_cow_group_count(int group);
-void		cow_init();
-void 		cow_group_init(int groupno);
-struct 		cow_group* get_cow_group(int group);
-int		is_shmem(int group, uint64 pa);
-void 		add_shmem(int group, uint64 pa);
 int 		uvmcopy_cow(pagetable_t old, pagetable_t new, uint64 sz);
-void		copy_on_write();
+int		copy_on_write(struct proc*, uint64);
 
 // bio.c
 void            binit(void);
@@ -76,6 +69,8 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            krefinc(void *);    // CSE 536
+int             krefcnt(void *);    // CSE 536
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -119,6 +114,7 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            kthread(char*, void (*)(void));
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -197,6 +193,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwpages(uint, void **, int, int); // CSE 536
 void            virtio_disk_intr(void);
 
 // CSE 536: pfault.c
@@ -204,17 +201,38 @@ extern uint64   non_fault_addr;
 void            page_fault_handler(void);
 void            proc_pswap_diskblocks_init(void);
 void		init_psa_regions(void);
+int             psa_alloc(void);
+void            psa_free(int);
+void            psa_dup(int);
+int             copy_heap_tracker(struct proc*, struct proc*);
+int             vmstats_get(int, struct vmstats*);
+void            free_heap_tracker(struct proc*);
+void            pageout_init(void);
+
+// CSE 536: textcache.c
+void            textcache_init(void);
+uint64          textcache_get(struct inode*, uint, uint, int*);
+void            textcache_invalidate(uint, uint);
 
 // CSE 536: debug.h
-void print_copy_on_write(struct proc *p, uint64 vaddr);
 void print_static_proc(char* name);
 void print_ondemand_proc(char* name);
 void print_skip_section(char* name, uint64 vaddr, int size);
+void print_skip_heap_region(char* name, uint64 vaddr, int npages);
+// Per-fault tracing, only with PFTRACE; see getvmstats() for counts.
+#ifdef PFTRACE
+void print_copy_on_write(struct proc *p, uint64 vaddr);
 void print_page_fault(char* name, uint64 vaddr);
 void print_load_seg(uint64 vaddr, uint64 seg, int size);
-void print_skip_heap_region(char* name, uint64 vaddr, int npages);
 void print_evict_page(uint64 vaddr, int startblock);
 void print_retrieve_page(uint64 vaddr, int startblock);
+#else
+#define print_copy_on_write(p, vaddr)         do { } while(0)
+#define print_page_fault(name, vaddr)         do { } while(0)
+#define print_load_seg(vaddr, seg, size)      do { } while(0)
+#define print_evict_page(vaddr, startblock)   do { } while(0)
+#define print_retrieve_page(vaddr, startblock) do { } while(0)
+#endif
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -32,6 +32,9 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
+  struct inode *exe = 0, *oldexe;
+  struct od_seg seg[NODSEG];
+  int nseg = 0;
 
   if(!(memcmp(path, "/init", strlen("/init"))==0 || memcmp(path, "sh", strlen("sh"))==0 || memcmp(path, "test8-cow1", strlen("test8-cow1"))==0|| memcmp(path, "test9-cow2", strlen("test9-cow2"))==0 || memcmp(path, "test10-cow3", strlen("test10-cow3")==0)))
   {
@@ -78,7 +81,21 @@ exec(char *path, char **argv)
      if(ph.vaddr % PGSIZE != 0)
        goto bad;
      
-     if(p->ondemand == false)
+     /* CSE 536: record the segment for the fault handler. A program
+      * with more segments than fit is loaded eagerly past that point. */
+     if(p->ondemand == true && nseg < NODSEG)
+     {
+       if(sz < ph.vaddr + ph.memsz)
+	  sz = ph.vaddr + ph.memsz;
+       seg[nseg].vaddr  = ph.vaddr;
+       seg[nseg].memsz  = ph.memsz;
+       seg[nseg].off    = ph.off;
+       seg[nseg].filesz = ph.filesz;
+       seg[nseg].perm   = flags2perm(ph.flags);
+       nseg++;
+       print_skip_section(path, ph.vaddr, ph.memsz);
+     }
+     else
      {
        uint64 sz1;
 
@@ -88,17 +105,17 @@ exec(char *path, char **argv)
        if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
          goto bad;
      }
-      
-     else
-     {
-       if(sz < ph.vaddr + ph.memsz)
-	  sz = ph.vaddr + ph.memsz;
-       print_skip_section(path, ph.vaddr, ph.memsz);
-     }
 
  
   }
-  iunlockput(ip);
+  // CSE 536: an on-demand program keeps its file referenced
+  // for the page fault handler.
+  if(p->ondemand == true){
+    iunlock(ip);
+    exe = ip;
+  } else {
+    iunlockput(ip);
+  }
   end_op();
   ip = 0;
 
@@ -158,14 +175,19 @@ exec(char *path, char **argv)
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
 
-  // CSE 536: Clear all heap track regions
-  for (int i = 0; i < MAXHEAP; i++) {
-    p->heap_tracker[i].addr            = 0xFFFFFFFFFFFFFFFF;
-    p->heap_tracker[i].startblock      = -1;
-    p->heap_tracker[i].last_load_time  = 0xFFFFFFFFFFFFFFFF;
-    p->heap_tracker[i].loaded          = false;
+  oldexe = p->exe;
+  p->exe = exe;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
   }
-  p->resident_heap_pages = 0;
+
+  // CSE 536: Clear all heap track regions, returning any PSA slots
+  // the old image still held.
+  free_heap_tracker(p);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -176,6 +198,11 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
 
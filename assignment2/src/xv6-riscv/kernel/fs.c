@@ -429,6 +429,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  textcache_invalidate(ip->dev, ip->inum);  // CSE 536
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -512,6 +513,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  textcache_invalidate(ip->dev, ip->inum);  // CSE 536
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
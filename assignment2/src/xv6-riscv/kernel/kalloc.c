@@ -18,9 +18,15 @@ struct run {
   struct run *next;
 };
 
+// CSE 536: each page of physical memory counts its owners, so that
+// copy-on-write fork and the text cache can share a page between page
+// tables; kfree() drops one reference and frees the page at zero.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int ref[(PHYSTOP - KERNBASE) / PGSIZE];
 } kmem;
 
 void
@@ -35,22 +41,33 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kmem.ref[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc(), and free it with the last one.
+// (The exception is when initializing the allocator;
+// see kinit above.)
 void
 kfree(void *pa)
 {
   struct run *r;
+  int ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if((ref = --kmem.ref[PA2REF(pa)]) < 0)
+    panic("kfree: ref");
+  release(&kmem.lock);
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -72,11 +89,31 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[PA2REF(r)] = 1;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// CSE 536: add a reference to an allocated page.
+void
+krefinc(void *pa)
+{
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] <= 0)
+    panic("krefinc");
+  kmem.ref[PA2REF(pa)]++;
+  release(&kmem.lock);
+}
+
+// CSE 536: number of references to an allocated page.
+int
+krefcnt(void *pa)
+{
+  return kmem.ref[PA2REF(pa)];
+}
@@ -27,12 +27,14 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    textcache_init(); // CSE 536: shared program text pages
     virtio_disk_init(); // emulated hard disk
 
     /* CSE 536: Initialize all PSA regions when OS boots. */
     init_psa_regions();
 
     userinit();      // first user process
+    pageout_init();  // CSE 536: heap pageout daemon
     __sync_synchronize();
     started = 1;
   } else {
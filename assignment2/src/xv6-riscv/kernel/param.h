@@ -17,7 +17,24 @@
 #define PSASTART                33       // Starting page save area (PSA) block
 #define PSAEND                  4032     // Ending page save area (PSA) block
 #define PSASIZE                 4000     // total size of the PSA
+#define PSA_SLOTBLKS            4        // PSA blocks per swapped page (PGSIZE/BSIZE)
 
 /* CSE 536: heap-related definitions. */
 #define MAXHEAP                 1000     // maximum pages for heap allocation
+#define NODSEG                  8        // segments recorded for an on-demand program
+#define NTEXTPAGE               128      // pages in the shared program text cache
 #define MAXRESHEAP              100      // maximum in-memory pages for heap allocation
+#ifndef PAGEOUT_FREE
+#define PAGEOUT_FREE            0        // free resident heap pages kept by pageout (0: off)
+#endif
+#ifndef HEAP_RA_MAX
+#define HEAP_RA_MAX             0        // max heap pages read ahead / faulted around (0: off)
+#endif
+
+/* CSE 536: heap eviction policy, selected with EVICT_POLICY. */
+#define EVICT_FIFO              0        // oldest load time
+#define EVICT_CLOCK             1        // second chance on PTE_A
+#define EVICT_LRU               2        // aging approximation of LRU
+#ifndef EVICT_POLICY
+#define EVICT_POLICY            EVICT_CLOCK
+#endif
@@ -14,6 +14,9 @@
 int loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz);
 int flags2perm(int flags);
 
+/* CSE 536: system-wide paging statistics; see VMSTAT_ADD(). */
+struct vmstats vmstat;
+
 /* CSE 536: (2.4) read current time. */
 uint64 read_current_timestamp() {
   uint64 curticks = 0;
@@ -24,135 +27,449 @@ uint64 read_current_timestamp() {
   return curticks;
 }
 
-bool psa_tracker[PSASIZE];
+/* CSE 536: PSA swap-slot allocator. An evicted page occupies one slot of
+ * PSA_SLOTBLKS consecutive blocks; a set bit in used[] marks a busy slot.
+ * Words below hint are known to be full, so allocation normally inspects
+ * a single word and finds the free bit with lowbit(). A fork shares its
+ * parent's swapped pages, so a slot counts the heap trackers using it in
+ * ref[] and is released with the last one. */
+#define NPSASLOT  ((PSAEND - PSASTART) / PSA_SLOTBLKS)
+#define NPSAWORD  ((NPSASLOT + 63) / 64)
+
+struct {
+  struct spinlock lock;
+  uint64 used[NPSAWORD];
+  uint8 ref[NPSASLOT];
+  int hint;
+  int nfree;
+} psa;
+
+// index of the lowest set bit in x, which must be non-zero.
+static int
+lowbit(uint64 x)
+{
+  int n = 0;
+
+  if((x & 0xffffffff) == 0){ n += 32; x >>= 32; }
+  if((x & 0xffff) == 0){ n += 16; x >>= 16; }
+  if((x & 0xff) == 0){ n += 8; x >>= 8; }
+  if((x & 0xf) == 0){ n += 4; x >>= 4; }
+  if((x & 0x3) == 0){ n += 2; x >>= 2; }
+  if((x & 0x1) == 0)
+    n += 1;
+  return n;
+}
 
 /* All blocks are free during initialization. */
 void init_psa_regions(void)
 {
-    for (int i = 0; i < PSASIZE; i++) 
-        psa_tracker[i] = false;
+    initlock(&psa.lock, "psa");
+    for (int i = 0; i < NPSAWORD; i++)
+        psa.used[i] = 0;
+    /* Tail bits past the last slot are never handed out. */
+    for (int i = NPSASLOT; i < NPSAWORD*64; i++)
+        psa.used[i/64] |= 1L << (i%64);
+    psa.hint = 0;
+    psa.nfree = NPSASLOT;
 }
 
-/* Evict heap page to disk when resident pages exceed limit */
-void evict_page_to_disk(struct proc* p) {
-    /* Find free block :*/
-    int blockno = 0;
-    for(int i=0; i<(PSASIZE-PSASTART); i++){
-   	if(psa_tracker[i] == false){
- 	   blockno = i;
+/* Reserve a PSA slot. Returns its first block (relative to PSASTART),
+ * or -1 if the PSA is full. */
+int psa_alloc(void)
+{
+    int blockno = -1;
 
- 	   break;
+    acquire(&psa.lock);
+    for (int w = psa.hint; w < NPSAWORD; w++) {
+        if (psa.used[w] != ~0UL) {
+            int bit = lowbit(~psa.used[w]);
+            psa.used[w] |= 1L << bit;
+            psa.ref[w*64 + bit] = 1;
+            psa.nfree--;
+            psa.hint = w;
+            blockno = (w*64 + bit) * PSA_SLOTBLKS;
+            break;
         }
     }
-     
-    /* Find victim page using FIFO. */
-    int victim_page_index = -1;
-    for(int i=0; i<MAXHEAP; i++)
-    {   
-       if(p->heap_tracker[i].loaded == 0){
-          if(victim_page_index == -1 || (p->heap_tracker[i].last_load_time < p->heap_tracker[victim_page_index].last_load_time)){      	    victim_page_index = i;
-          }
-       }
+    if (blockno < 0)
+        psa.hint = NPSAWORD;
+    release(&psa.lock);
+    return blockno;
+}
+
+/* Slot number of the in-use slot starting at blockno. Caller holds
+ * psa.lock. */
+static int
+psa_slot(int blockno)
+{
+    int slot = blockno / PSA_SLOTBLKS;
+
+    if (blockno < 0 || blockno % PSA_SLOTBLKS || slot >= NPSASLOT)
+        panic("psa: bad block");
+    if ((psa.used[slot/64] & (1L << (slot%64))) == 0)
+        panic("psa: slot not in use");
+    return slot;
+}
+
+/* Another heap tracker now refers to the slot starting at blockno. */
+void psa_dup(int blockno)
+{
+    acquire(&psa.lock);
+    psa.ref[psa_slot(blockno)]++;
+    release(&psa.lock);
+}
+
+/* Drop a reference to the slot starting at blockno, releasing the slot
+ * with the last one. */
+void psa_free(int blockno)
+{
+    acquire(&psa.lock);
+    int slot = psa_slot(blockno);
+    if (--psa.ref[slot] > 0) {
+        release(&psa.lock);
+        return;
     }
-    for(int i = blockno; i< (blockno)+4; i++)
-    {
- 	psa_tracker[i] = true;
+    psa.used[slot/64] &= ~(1L << (slot%64));
+    psa.nfree++;
+    if (slot/64 < psa.hint)
+        psa.hint = slot/64;
+    release(&psa.lock);
+}
+
+/* Release p's PSA slots and forget all of its heap pages. */
+void free_heap_tracker(struct proc* p)
+{
+    for (int i = 0; i < p->heap_pages; i++) {
+        struct heap_tracker_t *h = HEAP_PAGE(p, i);
+        if (h->loaded && h->startblock >= 0)
+            psa_free(h->startblock);
     }
-   
-    uint64 victim_page_addr = p->heap_tracker[victim_page_index].addr;
+    for (int i = 0; i < HEAP_DIRSIZE; i++) {
+        if (p->heap_dir[i])
+            kfree(p->heap_dir[i]);
+        p->heap_dir[i] = 0;
+    }
+    p->heap_base = 0;
+    p->heap_pages = 0;
+    p->resident_heap_pages = 0;
+    p->vmstat.psaused = 0;
+    p->clock_hand = 0;
+    p->ra_next = 0;
+    p->ra_win = 0;
+}
+
+/* Give child np a copy of p's heap tracker at fork. The child's page
+ * table already holds p's resident heap pages; swapped-out pages are
+ * shared by taking a reference to their PSA slots, and each process
+ * reads its own copy back when it touches the page. */
+int copy_heap_tracker(struct proc* p, struct proc* np)
+{
+    int ndir = (p->heap_pages + HEAP_PER_PAGE - 1) / HEAP_PER_PAGE;
+
+    for (int i = 0; i < ndir; i++) {
+        if ((np->heap_dir[i] = kalloc()) == 0)
+            return -1;
+        memmove(np->heap_dir[i], p->heap_dir[i], PGSIZE);
+    }
+    for (int i = 0; i < p->heap_pages; i++) {
+        struct heap_tracker_t *h = HEAP_PAGE(p, i);
+        if (h->loaded && h->startblock >= 0)
+            psa_dup(h->startblock);
+    }
+    np->heap_base = p->heap_base;
+    np->heap_pages = p->heap_pages;
+    np->resident_heap_pages = p->resident_heap_pages;
+    np->clock_hand = p->clock_hand;
+    np->vmstat.psaused = p->vmstat.psaused;
+    return 0;
+}
+
+/* CSE 536: PTE of heap page i if it is resident and mapped, else 0.
+ * Only such pages are eviction candidates. */
+static pte_t*
+resident_heap_pte(struct proc* p, int i)
+{
+    pte_t *pte;
+
+    if (HEAP_PAGE(p, i)->loaded)
+        return 0;
+    pte = walk(p->pagetable, HEAP_PAGE(p, i)->addr, 0);
+    if (pte == 0 || (*pte & PTE_V) == 0)
+        return 0;
+    return pte;
+}
+
+#if EVICT_POLICY == EVICT_FIFO
+/* Oldest load time goes first. */
+static int
+select_victim(struct proc* p)
+{
+    int victim = -1;
+    for (int i = 0; i < p->heap_pages; i++) {
+        if (resident_heap_pte(p, i) == 0)
+            continue;
+        if (victim == -1 || HEAP_PAGE(p, i)->last_load_time < HEAP_PAGE(p, victim)->last_load_time)
+            victim = i;
+    }
+    return victim;
+}
+#elif EVICT_POLICY == EVICT_CLOCK
+/* Second chance: sweep p->clock_hand over the heap pages, clearing PTE_A
+ * on referenced pages and taking the first one found unreferenced. The
+ * hand persists across evictions, so each costs amortized O(1). */
+static int
+select_victim(struct proc* p)
+{
+    pte_t *pte;
+
+    for (int n = 0; n <= 2*p->heap_pages; n++) {
+        int i = p->clock_hand;
+        if (i >= p->heap_pages) {
+            p->clock_hand = 0;
+            continue;
+        }
+        p->clock_hand = i + 1;
+        if ((pte = resident_heap_pte(p, i)) == 0)
+            continue;
+        if (*pte & PTE_A) {
+            *pte &= ~PTE_A;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+#elif EVICT_POLICY == EVICT_LRU
+/* Aging: shift each resident page's history right, fold PTE_A into the
+ * top bit and evict the smallest history, oldest load first on ties. */
+static int
+select_victim(struct proc* p)
+{
+    pte_t *pte;
+    int victim = -1;
+
+    for (int i = 0; i < p->heap_pages; i++) {
+        if ((pte = resident_heap_pte(p, i)) == 0)
+            continue;
+        struct heap_tracker_t *h = HEAP_PAGE(p, i);
+        h->age >>= 1;
+        if (*pte & PTE_A) {
+            h->age |= 0x80;
+            *pte &= ~PTE_A;
+        }
+        if (victim == -1 || h->age < HEAP_PAGE(p, victim)->age ||
+            (h->age == HEAP_PAGE(p, victim)->age &&
+             h->last_load_time < HEAP_PAGE(p, victim)->last_load_time))
+            victim = i;
+    }
+    return victim;
+}
+#else
+#error "unknown EVICT_POLICY"
+#endif
+
+/* Evict heap page to disk when resident pages exceed limit.
+ * Returns -1 if there is no free PSA slot or no resident victim. */
+int evict_page_to_disk(struct proc* p) {
+    /* Find victim page using the configured policy. */
+    int victim_page_index = select_victim(p);
+    if (victim_page_index < 0)
+        return -1;
+
+    /* Find free block :*/
+    int blockno = psa_alloc();
+    if (blockno < 0)
+        return -1;
+
+    struct heap_tracker_t *victim = HEAP_PAGE(p, victim_page_index);
+    uint64 victim_page_addr = victim->addr;
     
     /* Set bool loaded to true for the victim page */
-    p->heap_tracker[victim_page_index].loaded = 1;
+    victim->loaded = 1;
     
     /* Set startblock field for the victim page*/
-    p->heap_tracker[victim_page_index].startblock = blockno;
-    char *kernel_page = kalloc();
+    victim->startblock = blockno;
 
     /* Print statement. */
     print_evict_page(victim_page_addr, blockno);
- 
-    /* Read memory from the user to kernel memory first. */
-    copyin(p->pagetable, kernel_page, victim_page_addr, PGSIZE);
-   
-    /* Write to the disk blocks. Below is a template as to how this works. There is
-      * definitely a better way but this works for now. :p */
- 
-    int count=0;
-    for(uint64 i=0x4000; i<0x3eb000; i+=0x1000)
-    {
-	if(i==victim_page_addr)
-	{
-	   break;
-	}
-	count++;
-    }
-    struct buf* b;
-    for(int i=0; i<4; i++)
-    {
-    	b = bread(1, PSASTART+blockno+i);
-    	memmove(b->data, kernel_page+(1024*i), 1024);
-    	bwrite(b);
-    	brelse(b);
+
+    /* Write the user page straight to its PSA slot in one request. */
+    uint64 pa = walkaddr(p->pagetable, victim_page_addr);
+    if (pa == 0)
+        panic("evict_page_to_disk: victim not mapped");
+    void *page = (void*)pa;
+    virtio_disk_rwpages(PSASTART+blockno, &page, 1, 1);
+    VMSTAT_ADD(p, swapout, 1);
+    p->vmstat.psaused++;
+
+    /* Unmap swapped out page and free its memory. */
+    uvmunmap(p->pagetable, victim_page_addr, 1, 1);
+    p->resident_heap_pages -= 1;
+    return 0;
+}
+
+/* CSE 536: pageout daemon. A kernel thread that keeps at least
+ * PAGEOUT_FREE resident heap slots free in each on-demand process, so
+ * heap faults normally map a page without writing one out first.
+ *
+ * There is no cross-CPU TLB shootdown, and kernel code may hold a
+ * physical address it got from walkaddr() across a preemption, so the
+ * daemon only touches a process that was preempted in user mode
+ * (p->user_yield). It parks the process in PFAULT while evicting, which
+ * keeps the scheduler away; the process flushes its TLB when it next
+ * returns to user space. resident_heap_pages is only changed by the
+ * process itself or by the daemon while it is parked, so the daemon
+ * reads it under p->lock to pick a process and then without the lock
+ * while the process stays parked. */
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;
+  int wanted;
+} pageout;
+
+/* Called from the fault path when a process drops below the watermark. */
+static void
+pageout_wakeup(void)
+{
+    acquire(&pageout.lock);
+    pageout.wanted = 1;
+    wakeup(&pageout);
+    release(&pageout.lock);
+}
+
+static void
+pageout_daemon(void)
+{
+    struct proc *p;
+
+    for (;;) {
+        acquire(&pageout.lock);
+        while (!pageout.wanted)
+            sleep(&pageout, &pageout.lock);
+        pageout.wanted = 0;
+        release(&pageout.lock);
+
+        for (p = proc; p < &proc[NPROC]; p++) {
+            acquire(&p->lock);
+            if (p->state != RUNNABLE || !p->user_yield || !p->ondemand ||
+                p->resident_heap_pages <= MAXRESHEAP - PAGEOUT_FREE) {
+                release(&p->lock);
+                continue;
+            }
+            p->state = PFAULT;
+            release(&p->lock);
+
+            while (p->resident_heap_pages > MAXRESHEAP - PAGEOUT_FREE)
+                if (evict_page_to_disk(p) < 0)
+                    break;
+
+            acquire(&p->lock);
+            p->state = RUNNABLE;
+            release(&p->lock);
+        }
     }
-      // printf("Working till memmove\n\n");
-    
+}
 
-    /* Unmap swapped out page */
-    uvmunmap(p->pagetable, victim_page_addr, 1, 0);
+void pageout_init(void)
+{
+    initlock(&pageout.lock, "pageout");
+    if (PAGEOUT_FREE > 0)
+        kthread("pageout", pageout_daemon);
+}
 
+/* CSE 536: bookkeeping for heap page i having just been mapped. */
+static void
+heap_page_mapped(struct proc* p, int i)
+{
+    HEAP_PAGE(p, i)->last_load_time = read_current_timestamp();
+    HEAP_PAGE(p, i)->age = 0;
+    p->resident_heap_pages += 1;
 }
 
-/* Retrieve faulted page from disk. */
-void retrieve_page_from_disk(struct proc* p, uint64 uvaddr) {
-    
-     int blockno = -1;
-     for(int i=0; i<MAXHEAP; i++)
-     {
-	if(p->heap_tracker[i].addr == uvaddr && p->heap_tracker[i].loaded == 1)
-	{
-	   blockno = p->heap_tracker[i].startblock;
-	   p->heap_tracker[i].loaded = 0;
-	}
-     }
-     if(blockno == -1)
-	return;
+/* CSE 536: length of the run of heap pages starting at faulting page i
+ * that one fault should map: page i plus up to extra pages right above
+ * it in the same state, i.e. swapped out to the slots that follow i's
+ * slot, or never touched. */
+static int
+heap_run(struct proc* p, int i, int extra)
+{
+    struct heap_tracker_t *h = HEAP_PAGE(p, i);
+    int n;
 
-	
- 
-     /*Kernel Page allocation*/  
-     char *kernel_page = kalloc();
-
-     struct buf* b;
-     for(int i=0; i<4; i++)
-     {
-	int block_to_read = PSASTART+blockno+i;
-	b = bread(1, block_to_read);
-	memmove(kernel_page+(1024*i), b->data, 1024);
-	brelse(b);
-     }
+    for (n = 1; n <= extra && i+n < p->heap_pages; n++) {
+        struct heap_tracker_t *next = HEAP_PAGE(p, i+n);
+        if (h->loaded) {
+            if (!next->loaded || next->startblock != h->startblock + n*PSA_SLOTBLKS)
+                break;
+        } else if (next->loaded || walkaddr(p->pagetable, next->addr) != 0) {
+            break;
+        }
+    }
+    return n;
+}
 
-    /* int* byteval = (int *)kernel_page;
-     for(int i=0; i<1024; i++)
-     {
-	printf("%d-", byteval[i]); 
-     }
-     printf("\n");*/
-    
-     uvmalloc(p->pagetable, uvaddr, uvaddr+PGSIZE, PTE_W);
-     copyout(p->pagetable, uvaddr, kernel_page, PGSIZE);
-     print_retrieve_page(uvaddr, blockno);
-     for(int i = blockno; i<blockno+4; i++)
-     {
-	psa_tracker[i] = false;
+/* Retrieve faulted page from disk, together with the n-1 pages after it
+ * (read-ahead, see heap_run()), in one batched read. Returns the number
+ * of pages mapped, which is 0 if out of memory. Pages of the run that
+ * could not be mapped keep their PSA slots and are read again later. */
+int retrieve_page_from_disk(struct proc* p, int i, int n) {
+     void *mem[1+HEAP_RA_MAX];
+     int blockno = HEAP_PAGE(p, i)->startblock;
+     int k;
+
+     for (k = 0; k < n; k++)
+        if ((mem[k] = kalloc()) == 0)
+            break;
+     n = k;
+     if (n == 0)
+        return 0;
+
+     /* Read the slots straight into fresh pages and map them. */
+     virtio_disk_rwpages(PSASTART+blockno, mem, n, 0);
+     for (k = 0; k < n; k++) {
+        uint64 va = HEAP_PAGE(p, i+k)->addr;
+        if (mappages(p->pagetable, va, PGSIZE, (uint64)mem[k], PTE_R|PTE_U|PTE_W) != 0)
+            break;
+        HEAP_PAGE(p, i+k)->loaded = 0;
+        print_retrieve_page(va, blockno + k*PSA_SLOTBLKS);
+        psa_free(blockno + k*PSA_SLOTBLKS);
+        heap_page_mapped(p, i+k);
      }
-    
+     for (int j = k; j < n; j++)
+        kfree(mem[j]);
+     VMSTAT_ADD(p, swapin, k);
+     p->vmstat.psaused -= k;
+     return k;
 }
 
+/* Map zero-filled pages for heap page i and the n-1 untouched pages
+ * after it (fault-around). Returns the number of pages mapped, which is
+ * 0 if out of memory. */
+static int
+zero_fill_heap(struct proc* p, int i, int n)
+{
+    for (int k = 0; k < n; k++) {
+        char *mem = kalloc();
+        if (mem == 0)
+            return k;
+        memset(mem, 0, PGSIZE);
+        if (mappages(p->pagetable, HEAP_PAGE(p, i+k)->addr, PGSIZE, (uint64)mem, PTE_R|PTE_U|PTE_W) != 0) {
+            kfree(mem);
+            return k;
+        }
+        heap_page_mapped(p, i+k);
+        VMSTAT_ADD(p, zerofill, 1);
+    }
+    return n;
+}
 
 void page_fault_handler(void) 
 {
     /* Current process struct */
     struct proc *p = myproc();
+    uint64 start = r_cycle();
+    int major = 0;  // did this fault read the disk?
    
     /* Track whether the heap page should be brought back from disk or not. */
     bool load_from_disk = true;
@@ -162,127 +479,209 @@ void page_fault_handler(void)
     uint64 faulting_addr = r_stval();
    
     uint64 aligned_addr = faulting_addr & ~(PGSIZE-1);
-      
-	
-    for(int i =0; i<MAXHEAP; i++)
-    {
-       if(p->heap_tracker[i].addr == aligned_addr)
-       {
-	      load_from_disk = false;
-              page_index = i;
-	      goto heap_handle;
-	      goto out;
-       }
+
+    if(aligned_addr >= MAXVA){
+       printf("page_fault_handler: bad address %p pid=%d\n", faulting_addr, p->pid);
+       setkilled(p);
+       goto out;
     }
-  
+	
+    /* CSE 536: a store to a resident page shared by a CoW fork; this
+     * includes heap pages, so check it first. */
     if(p->cow_enabled == 1 && r_scause() == 15)
     {
        pte_t *pte = walk(p->pagetable, aligned_addr, 0);
-       if((*pte & PTE_V) && !(*pte & PTE_W))
+       if(pte != 0 && (*pte & PTE_V) && !(*pte & (PTE_W|PTE_TEXT)))
        {
           print_page_fault(p->name, (r_stval() & ~(PGSIZE-1)));
-          copy_on_write();
+          print_copy_on_write(p, aligned_addr);
+          if(copy_on_write(p, aligned_addr) < 0){
+             printf("page_fault_handler: out of memory pid=%d\n", p->pid);
+             setkilled(p);
+          }
           goto out;
        }
     }
+
+    /* CSE 536: any other fault on a page that is already mapped is a
+     * store or protection violation, e.g. a write to text. */
+    pte_t *pte = walk(p->pagetable, aligned_addr, 0);
+    if(pte != 0 && (*pte & PTE_V)){
+       printf("page_fault_handler: bad access %p pid=%d\n", faulting_addr, p->pid);
+       setkilled(p);
+       goto out;
+    }
+
+    /* CSE 536: heap pages are indexed by their offset from heap_base. */
+    if(aligned_addr >= p->heap_base &&
+       (aligned_addr - p->heap_base) / PGSIZE < p->heap_pages)
+    {
+       load_from_disk = false;
+       page_index = (aligned_addr - p->heap_base) / PGSIZE;
+       goto heap_handle;
+    }
     
+    /* CSE 536: text/data page of an on-demand program. exec() recorded
+     * its segments and kept the file referenced, so load the page
+     * without looking up or parsing the ELF file again. */
     if(load_from_disk)
     {     
-       struct elfhdr elf;
-       struct proghdr ph;
-       struct inode *ip;
-       pagetable_t pagetable = p->pagetable;
-       begin_op();
-       if((ip = namei(p->name))==0){
-          panic("File not Found\n");
+       struct od_seg *seg = 0;
+       for(int i = 0; i < p->nseg; i++){
+          if(aligned_addr >= p->seg[i].vaddr && aligned_addr < p->seg[i].vaddr + p->seg[i].memsz){
+             seg = &p->seg[i];
+             break;
+          }
+       }
+       if(seg == 0 || p->exe == 0){
+          printf("page_fault_handler: bad address %p pid=%d\n", faulting_addr, p->pid);
+          setkilled(p);
+          goto out;
        }
-    
-       ilock(ip);
-       readi(ip, 0, (uint64)&elf, 0, sizeof(elf));
-    
-       if(elf.magic != ELF_MAGIC)
-          panic("Invalid ELF file\n");
 
-       for(int i=0, off = elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
-          readi(ip, 0, (uint64)&ph, off, sizeof(ph));
-          if(ph.type != ELF_PROG_LOAD){
-             continue;
+       uint64 off = aligned_addr - seg->vaddr;
+       uint n = 0;
+       if(off < seg->filesz)
+          n = seg->filesz - off < PGSIZE ? seg->filesz - off : PGSIZE;
+
+       /* Read-only pages are the same in every process running the
+        * program: map the shared copy from the text cache. */
+       uint64 pa;
+       if(!(seg->perm & PTE_W) &&
+          (pa = textcache_get(p->exe, seg->off + off, n, &major)) != 0){
+          if(mappages(p->pagetable, aligned_addr, PGSIZE, pa,
+                      PTE_R|PTE_U|PTE_TEXT|seg->perm) != 0){
+             kfree((void*)pa);  // the reference taken for this mapping
+             goto oom;
           }
-      
-     
-          if(aligned_addr >= ph.vaddr && aligned_addr < (ph.vaddr+ph.memsz)){
-             uint64 sz1;
-	     if((sz1 = uvmalloc(pagetable, aligned_addr, aligned_addr+PGSIZE, flags2perm(ph.flags)))==0)
-	        panic("Failed to allocate a page\n");
-         
-             if(loadseg(pagetable, aligned_addr, ip, ph.off+(aligned_addr - ph.vaddr), PGSIZE)<0)
-	        panic("Failed to load segment\n");		
-	 
-     	     break;
+          print_page_fault(p->name, aligned_addr);
+          print_load_seg(aligned_addr, seg->off + off, PGSIZE);
+          goto out;
+       }
+
+       if(uvmalloc(p->pagetable, aligned_addr, aligned_addr+PGSIZE, seg->perm) == 0)
+          goto oom;
+
+       /* Only filesz bytes come from the file; uvmalloc zeroed the rest. */
+       if(n > 0){
+          major = 1;
+          ilock(p->exe);
+          int r = loadseg(p->pagetable, aligned_addr, p->exe, seg->off + off, n);
+          iunlock(p->exe);
+          if(r < 0){
+             printf("page_fault_handler: cannot load %p pid=%d\n", faulting_addr, p->pid);
+             setkilled(p);
+             goto out;
           }
        }
-       iunlockput(ip);
-       end_op();
-       ip =0;
        print_page_fault(p->name, aligned_addr);
-       print_load_seg(aligned_addr, ph.off+(aligned_addr-ph.vaddr), PGSIZE);
+       print_load_seg(aligned_addr, seg->off + off, PGSIZE);
     }
    
      // goto heap_handle;
     /* Go to out, since the remainder of this code is for the heap. */
     goto out;
 
+oom:
+    printf("page_fault_handler: out of memory pid=%d\n", p->pid);
+    setkilled(p);
+    goto out;
+
 heap_handle:
 
     print_page_fault(p->name, aligned_addr);
  
-    /* 2.4: Check if resident pages are more than heap pages. If yes, evict. */
-    if (p->resident_heap_pages == MAXRESHEAP) {
-        evict_page_to_disk(p);
-        p->resident_heap_pages -= 1;
+    /* CSE 536: a fault on the page right after the last run that was
+     * mapped is sequential; keep doubling the read-ahead window while it
+     * stays that way and drop it on a random access. */
+    int extra = 0;
+    if (page_index == p->ra_next)
+        extra = p->ra_win ? 2*p->ra_win : 1;
+    if (extra > HEAP_RA_MAX)
+        extra = HEAP_RA_MAX;
+    p->ra_win = extra;
+    int npages = heap_run(p, page_index, extra);
+
+    /* 2.4: Check if resident pages are more than heap pages. If yes, evict.
+     * Normally the pageout daemon has already made room. */
+    while (p->resident_heap_pages + npages > MAXRESHEAP) {
+        if (evict_page_to_disk(p) < 0) {
+            if (p->resident_heap_pages >= MAXRESHEAP) {
+                printf("page_fault_handler: swap full pid=%d\n", p->pid);
+                setkilled(p);
+                goto out;
+            }
+            npages = MAXRESHEAP - p->resident_heap_pages;
+        }
     }
-    
- 
-    if(p->heap_tracker[page_index].loaded == 1)
+
+    int mapped;
+    if(HEAP_PAGE(p, page_index)->loaded == 1)
     {
 	load_from_disk = true;
     } 
     /* 2.4: Heap page was swapped to disk previously. We must load it from disk. */
     if (load_from_disk) {
-        retrieve_page_from_disk(p, aligned_addr);
+        mapped = retrieve_page_from_disk(p, page_index, npages);
+        major = 1;
     }
     else
     {
-   /* 2.3: Map a heap page into the process' address space. (Hint: check growproc) */
-    	uint64 sz = p->sz;
-    	sz = uvmalloc(p->pagetable, sz, sz+PGSIZE, PTE_W);
-    	p->sz = sz; 
-    }	  
-
-
-    /* 2.4: Update the last load time for the loaded heap page in p->heap_tracker. */
-
-    for(int i =0; i< MAXHEAP; i++)
-    { 
-	   if(p->heap_tracker[i].addr == aligned_addr)
-	   {  
-	      p->heap_tracker[i].last_load_time = read_current_timestamp();
- 	   }
-    }	
-  
-
-
-
+        /* 2.3: Map a heap page into the process' address space. */
+        mapped = zero_fill_heap(p, page_index, npages);
+    }
+    if (mapped == 0) {
+        printf("page_fault_handler: out of memory pid=%d\n", p->pid);
+        p->ra_win = 0;
+        setkilled(p);
+        goto out;
+    }
+    p->ra_next = page_index + mapped;
 
-      
-       
-   
-    /* Track that another heap page has been brought into memory. */
-    p->resident_heap_pages += 1;
+    if (PAGEOUT_FREE > 0 && p->resident_heap_pages > MAXRESHEAP - PAGEOUT_FREE)
+        pageout_wakeup();
 
    
 out:
+    if (major)
+        VMSTAT_ADD(p, majflt, 1);
+    else
+        VMSTAT_ADD(p, minflt, 1);
+    VMSTAT_ADD(p, pfcycles, r_cycle() - start);
+
     /* Flush stale page table entries. This is important to always do. */
     sfence_vma();
     return;
 }
+
+/* CSE 536: pid's paging statistics, or the system-wide totals for pid 0.
+ * Returns -1 if there is no such process. */
+int vmstats_get(int pid, struct vmstats *st)
+{
+    struct proc *q;
+
+    if (pid == 0) {
+        *st = vmstat;
+        st->resident = 0;
+        for (q = proc; q < &proc[NPROC]; q++)
+            st->resident += q->resident_heap_pages;
+        acquire(&psa.lock);
+        st->psaused = NPSASLOT - psa.nfree;
+        release(&psa.lock);
+        st->psatotal = NPSASLOT;
+        return 0;
+    }
+
+    for (q = proc; q < &proc[NPROC]; q++) {
+        acquire(&q->lock);
+        if (q->pid == pid && q->state != UNUSED) {
+            *st = q->vmstat;
+            st->resident = q->resident_heap_pages;
+            st->psatotal = NPSASLOT;
+            release(&q->lock);
+            return 0;
+        }
+        release(&q->lock);
+    }
+    return -1;
+}
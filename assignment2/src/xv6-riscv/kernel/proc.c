@@ -6,22 +6,12 @@
 #include "proc.h"
 #include "defs.h"
 
-#define SHMEM_MAX 100
-
 struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
 struct proc *initproc;
 
-struct cow_group
-{
-    int group; // group id
-    uint64 shmem[SHMEM_MAX]; // list of pages a CoW group share
-    int count; // Number of active processes
-};
-
-
 int nextpid = 1;
 struct spinlock pid_lock;
 
@@ -172,6 +162,8 @@ freeproc(struct proc *p)
     if(p->pagetable)
       proc_freepagetable(p->pagetable, p->sz);
     p->pagetable = 0;
+    /* CSE 536: release the PSA slots of swapped-out heap pages. */
+    free_heap_tracker(p);
     p->sz = 0;
     p->pid = 0;
     p->parent = 0;
@@ -179,6 +171,8 @@ freeproc(struct proc *p)
     p->chan = 0;
     p->killed = 0;
     p->xstate = 0;
+    p->cow_enabled = 0;
+    memset(&p->vmstat, 0, sizeof(p->vmstat));
     p->state = UNUSED;
   
 }
@@ -266,18 +260,57 @@ userinit(void)
   release(&p->lock);
 }
 
-/* CSE 536: tracking each heap page allocated to the process. */
-void track_heap(struct proc* p, uint64 start, int npages) {
-  for (int i = 0; i < MAXHEAP; i++) {
-    if (p->heap_tracker[i].addr == 0xFFFFFFFFFFFFFFFF) {
-      p->heap_tracker[i].addr           = start + (i*PGSIZE);
-      p->heap_tracker[i].loaded         = 0;   
-      p->heap_tracker[i].startblock     = -1;
-      npages--;
-      if (npages == 0) return;
-    } 
+// CSE 536: a kernel thread's first scheduling by scheduler()
+// will swtch here instead of forkret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kthread_fn();
+  panic("kthread returned");
+}
+
+// CSE 536: start a kernel thread running fn(), which must never
+// return. It is a process that never enters user space.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kthread_fn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+/* CSE 536: tracking each heap page allocated to the process.
+ * Returns -1 if the heap would exceed MAXHEAP pages. */
+int track_heap(struct proc* p, uint64 start, int npages) {
+  if (npages <= 0) return 0;
+  if (p->heap_pages + npages > MAXHEAP) return -1;
+  if (p->heap_pages == 0)
+    p->heap_base = start;
+  for (int i = p->heap_pages; i < p->heap_pages + npages; i++) {
+    if (i % HEAP_PER_PAGE == 0 && p->heap_dir[i / HEAP_PER_PAGE] == 0) {
+      if ((p->heap_dir[i / HEAP_PER_PAGE] = kalloc()) == 0)
+        return -1;
+      memset(p->heap_dir[i / HEAP_PER_PAGE], 0, PGSIZE);
+    }
+    struct heap_tracker_t *h = HEAP_PAGE(p, i);
+    h->addr           = p->heap_base + (uint64)i*PGSIZE;
+    h->last_load_time = 0xFFFFFFFFFFFFFFFF;
+    h->loaded         = 0;
+    h->startblock     = -1;
+    h->age            = 0;
   }
-  panic("Error: No more process heap pages allowed.\n");
+  p->heap_pages += npages;
+  return 0;
 }
 
 // Grow or shrink user memory by n bytes.
@@ -309,10 +342,14 @@ growproc(int n)
      }
      p->sz = sz;
   }
-  else
+  else if(n > 0)
   { 
+    /* The heap is reserved now and faulted in page by page later. */
+    n = PGROUNDUP(n);
     print_skip_heap_region(p->name, p->sz, n/PGSIZE);
-    track_heap(p, p->sz, n/PGSIZE);
+    if (track_heap(p, p->sz, n/PGSIZE) < 0)
+      return -1;
+    p->sz += n;
   }
   return 0;
 }
@@ -327,8 +364,6 @@ fork(int cow_enabled)
   struct proc *p = myproc();
   
   
-  uint64 sz = p->sz;
-  pte_t *pte;
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -340,36 +375,16 @@ fork(int cow_enabled)
   // Set the appropriate metadata to track a CoW group
   if(cow_enabled == 1)
   {
-     // Set the cow_group if this is the first process to fork
-     if(p->cow_group == 0)
-     {
-        p->cow_group = p->pid;
-	p->cow_enabled = 1;
-	cow_group_init(p->cow_group);
-     }
-          
-     // implement and call the uvm_copy() function defined in cow.c
+     // Share every page read-only; uvmcopy_cow() takes a reference
+     // to each, so whoever unmaps a page last frees it.
      if(uvmcopy_cow(p->pagetable, np->pagetable, p->sz)<0)
      {
 	freeproc(np);
 	release(&np->lock);
 	return -1;
      }
+     p->cow_enabled = 1;
      np->cow_enabled = 1;
-     uint64 va, pa;
-     for(va=0; va<sz; va+=PGSIZE )
-     {
-	pte = walk(p->pagetable, va, 0);
-	if(pte != 0 && (*pte & PTE_V))
-	{
-	   pa = PTE2PA(*pte);
-	   add_shmem(p->cow_group, pa);
-	   
-	}	
-     }
-     incr_cow_group_count(p->cow_group);
-     np->cow_group = p->cow_group;
-     
   }
   else
   {
@@ -382,6 +397,14 @@ fork(int cow_enabled)
   }
   np->sz = p->sz;
 
+  /* CSE 536: the child inherits the on-demand heap, including pages
+   * that are swapped out. */
+  if(copy_heap_tracker(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -400,6 +423,9 @@ fork(int cow_enabled)
    * sh is always forked on any command, and it is reexecuted
    * from its forked counterpart. */
   np->ondemand = p->ondemand;
+  np->exe = p->exe ? idup(p->exe) : 0;
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
 
   pid = np->pid;
 
@@ -437,11 +463,8 @@ reparent(struct proc *p)
 void
 exit(int status)
 {
-  init_psa_regions();
   struct proc *p = myproc();
-  if(p->cow_enabled)
-    decr_cow_group_count(p->cow_group);
- 
+
   if(p == initproc)
     panic("init exiting");
 
@@ -456,8 +479,11 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    iput(p->exe);
   end_op();
   p->cwd = 0;
+  p->exe = 0;
 
   acquire(&wait_lock);
 
@@ -762,6 +788,7 @@ procdump(void)
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
   [ZOMBIE]    "zombie",
+  [PFAULT]    "pfault",
   };
   struct proc *p;
   char *state;
@@ -1,5 +1,6 @@
 #include <stddef.h>
 #include <stdbool.h>
+#include "vmstat.h"
 
 // Saved registers for kernel context switches.
 struct context {
@@ -82,7 +83,7 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
-enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE, PFAULT };
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE, PFAULT };  // PFAULT: held off the CPUs by the pageout daemon
 
 /* CSE 536: Data structure to track a process' heap regions. */
 struct heap_tracker_t {
@@ -90,6 +91,25 @@ struct heap_tracker_t {
   uint64 last_load_time;        // when the page was loaded into memory
   bool   loaded;                // has the heap page been loaded yet
   int    startblock;            // if located in disk, the starting block
+  uint8  age;                   // reference history for EVICT_LRU
+};
+
+/* CSE 536: heap page i is tracked by entry i%HEAP_PER_PAGE of the page
+ * heap_dir[i/HEAP_PER_PAGE]; these pages are allocated as the heap grows.
+ * Heap page i is at heap_base + i*PGSIZE, so a fault finds its entry
+ * without searching. */
+#define HEAP_PER_PAGE   (PGSIZE / sizeof(struct heap_tracker_t))
+#define HEAP_DIRSIZE    ((MAXHEAP + HEAP_PER_PAGE - 1) / HEAP_PER_PAGE)
+#define HEAP_PAGE(p, i) (&(p)->heap_dir[(i) / HEAP_PER_PAGE][(i) % HEAP_PER_PAGE])
+
+/* CSE 536: a loadable segment of an on-demand program, recorded by exec()
+ * so page faults need not look at the ELF file again. */
+struct od_seg {
+  uint64 vaddr;                 // first virtual address
+  uint64 memsz;                 // bytes in memory
+  uint64 off;                   // file offset of vaddr
+  uint64 filesz;                // bytes backed by the file; the rest is zero
+  int    perm;                  // PTE permissions, from flags2perm()
 };
 
 // Per-process state
@@ -118,9 +138,28 @@ struct proc {
 
   /* CSE 536: Variables defined for assignment #2. */
   bool                    ondemand;
-  struct heap_tracker_t   heap_tracker[MAXHEAP];
+  struct inode            *exe;        // on-demand program file, referenced
+  struct od_seg           seg[NODSEG]; // its loadable segments
+  int                     nseg;
+  struct heap_tracker_t   *heap_dir[HEAP_DIRSIZE];
+  uint64                  heap_base;   // address of heap page 0
+  int                     heap_pages;  // number of heap pages tracked
   int                     resident_heap_pages;
+  int                     clock_hand;  // next heap page index for EVICT_CLOCK
+  int                     ra_next;     // heap index a sequential fault would hit
+  int                     ra_win;      // current heap read-ahead window
+  bool                    user_yield;  // preempted in user mode; pageout may evict
+  void                    (*kthread_fn)(void);  // entry of a kernel thread
+  struct vmstats          vmstat;      // paging statistics
   
-  int cow_group;               // The group of processes sharing memory
   int cow_enabled;             // CoW enabled
 };
+
+/* CSE 536: count n paging events of kind f for p and system-wide.
+ * p's own counters are only updated by p, or by pageout while p is
+ * parked, so only the totals need an atomic add. */
+extern struct vmstats vmstat;
+#define VMSTAT_ADD(p, f, n) do { \
+  (p)->vmstat.f += (n); \
+  __sync_fetch_and_add(&vmstat.f, (n)); \
+} while(0)
@@ -92,3 +92,21 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+/* CSE 536: copy out paging statistics of a process, or the
+ * system-wide totals for pid 0. */
+uint64
+sys_getvmstats(void)
+{
+  int pid;
+  uint64 addr;
+  struct vmstats st;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  if(vmstats_get(pid, &st) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,145 @@
+// CSE 536: shared cache of program text pages.
+//
+// Read-only segments of on-demand programs are the same bytes in every
+// process running the program, so their pages are loaded once and mapped
+// into each process instead of being read into a private page per fault.
+//
+// An entry is keyed by (dev, inum, file offset) and holds one reference
+// to its page; every PTE mapping the page holds another (see kalloc.c),
+// and carries PTE_TEXT so fork shares the page instead of copying it.
+// An entry whose page only the cache references is unmapped; those stay
+// cached for the next exec of the program and are reused oldest-first.
+// Writing or truncating the file drops its entries; pages still mapped
+// are freed when their last mapping goes away.
+//
+// References to a cached page are only added under textcache.lock, so a
+// count of one seen under the lock stays one.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+struct textpage {
+  uint dev;
+  uint inum;
+  uint off;         // file offset of the page
+  uint64 pa;        // cached page, 0 if the entry is unused
+  uint64 lastuse;   // for reusing the oldest unmapped entry
+};
+
+struct {
+  struct spinlock lock;
+  struct textpage page[NTEXTPAGE];
+  uint64 clock;
+} textcache;
+
+void
+textcache_init(void)
+{
+  initlock(&textcache.lock, "textcache");
+}
+
+static struct textpage*
+textcache_find(uint dev, uint inum, uint off)
+{
+  struct textpage *t;
+
+  for(t = textcache.page; t < &textcache.page[NTEXTPAGE]; t++)
+    if(t->pa && t->inum == inum && t->dev == dev && t->off == off)
+      return t;
+  return 0;
+}
+
+// Return the physical page holding n bytes of ip at off (zero-filled
+// past n) with a reference for the caller's mapping, loading it on a
+// miss, in which case *loaded is set. Returns 0 if every entry is
+// mapped, in which case the caller loads a private page. ip must not be
+// locked.
+uint64
+textcache_get(struct inode *ip, uint off, uint n, int *loaded)
+{
+  struct textpage *t, *victim;
+  char *mem;
+
+  acquire(&textcache.lock);
+  if((t = textcache_find(ip->dev, ip->inum, off)) != 0){
+    krefinc((void*)t->pa);
+    t->lastuse = ++textcache.clock;
+    release(&textcache.lock);
+    return t->pa;
+  }
+  release(&textcache.lock);
+
+  // Read the page without the lock held; another process may miss on
+  // the same page meanwhile, and whichever inserts second uses the
+  // first one's copy.
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if(n > 0){
+    *loaded = 1;
+    ilock(ip);
+    if(readi(ip, 0, (uint64)mem, off, n) != n){
+      iunlock(ip);
+      kfree(mem);
+      return 0;
+    }
+    iunlock(ip);
+  }
+
+  acquire(&textcache.lock);
+  if((t = textcache_find(ip->dev, ip->inum, off)) != 0){
+    krefinc((void*)t->pa);
+    t->lastuse = ++textcache.clock;
+    release(&textcache.lock);
+    kfree(mem);
+    return t->pa;
+  }
+  victim = 0;
+  for(t = textcache.page; t < &textcache.page[NTEXTPAGE]; t++){
+    if(t->pa == 0){
+      victim = t;
+      break;
+    }
+    if(krefcnt((void*)t->pa) == 1 &&
+       (victim == 0 || t->lastuse < victim->lastuse))
+      victim = t;
+  }
+  if(victim == 0){
+    release(&textcache.lock);
+    kfree(mem);
+    return 0;
+  }
+  if(victim->pa)
+    kfree((void*)victim->pa);
+  victim->dev = ip->dev;
+  victim->inum = ip->inum;
+  victim->off = off;
+  victim->pa = (uint64)mem;
+  krefinc(mem);
+  victim->lastuse = ++textcache.clock;
+  release(&textcache.lock);
+  return (uint64)mem;
+}
+
+// The file's contents are changing: drop its cached pages.
+void
+textcache_invalidate(uint dev, uint inum)
+{
+  struct textpage *t;
+
+  acquire(&textcache.lock);
+  for(t = textcache.page; t < &textcache.page[NTEXTPAGE]; t++){
+    if(t->pa == 0 || t->inum != inum || t->dev != dev)
+      continue;
+    kfree((void*)t->pa);
+    t->pa = 0;
+  }
+  release(&textcache.lock);
+}
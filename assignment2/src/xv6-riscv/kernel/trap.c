@@ -83,8 +83,13 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // CSE 536: no kernel state refers to p's user pages here,
+  // so the pageout daemon may evict them while p waits.
+  if(which_dev == 2){
+    p->user_yield = true;
     yield();
+    p->user_yield = false;
+  }
 
   usertrapret();
 }
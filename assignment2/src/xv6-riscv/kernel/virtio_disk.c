@@ -46,7 +46,7 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    int *busy;   // cleared, and woken, by virtio_disk_intr().
     char status;
   } info[NUM];
 
@@ -196,12 +196,13 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
+// a disk transfer uses one for the header, one per data
+// buffer, and one for the status.
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,27 +213,32 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// issue one request that moves n buffers of len bytes each,
+// at the physical addresses in addr[], to or from consecutive
+// sectors starting at sector, and sleep until the device has
+// finished with it. *busy is set while the request is in flight.
+// caller holds vdisk_lock.
+static void
+disk_rw(uint64 sector, uint64 *addr, int n, uint len, int write, int *busy)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  if(n < 1 || n + 2 > NUM)
+    panic("disk_rw: bad buffer count");
 
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // data, one for a 1-byte status result. the data part may be
+  // split over several descriptors.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the descriptors.
+  int idx[NUM];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, n + 2) == 0) {
       break;
     }
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -249,24 +255,26 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 1; i <= n; i++){
+    disk.desc[idx[i]].addr = addr[i-1];
+    disk.desc[idx[i]].len = len;
+    if(write)
+      disk.desc[idx[i]].flags = 0; // device reads addr
+    else
+      disk.desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes addr
+    disk.desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i]].next = idx[i+1];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the busy flag for virtio_disk_intr().
+  *busy = 1;
+  disk.info[idx[0]].busy = busy;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -281,13 +289,45 @@ virtio_disk_rw(struct buf *b, int write)
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(*busy == 1) {
+    sleep(busy, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
+  disk.info[idx[0]].busy = 0;
   free_chain(idx[0]);
+}
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  uint64 addr = (uint64) b->data;
+
+  acquire(&disk.vdisk_lock);
+  disk_rw(b->blockno * (BSIZE / 512), &addr, 1, BSIZE, write, &b->disk);
+  release(&disk.vdisk_lock);
+}
+
+// CSE 536: transfer n whole pages between the physical pages in
+// pa[] and the PGSIZE/BSIZE-block slots that follow one another
+// from blockno, bypassing the buffer cache. each request carries
+// as many pages as the descriptor ring allows. used for PSA
+// swapping.
+void
+virtio_disk_rwpages(uint blockno, void **pa, int n, int write)
+{
+  uint64 addr[NUM-2];
+  int busy;
+
+  acquire(&disk.vdisk_lock);
+  while(n > 0){
+    int m = n < NUM-2 ? n : NUM-2;
+    for(int i = 0; i < m; i++)
+      addr[i] = (uint64) pa[i];
+    disk_rw(blockno * (BSIZE / 512), addr, m, PGSIZE, write, &busy);
+    blockno += m * (PGSIZE / BSIZE);
+    pa += m;
+    n -= m;
+  }
   release(&disk.vdisk_lock);
 }
 
@@ -316,9 +356,9 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    int *busy = disk.info[id].busy;
+    *busy = 0;   // disk is done with the buffer
+    wakeup(busy);
 
     disk.used_idx += 1;
   }
@@ -176,13 +176,15 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
   pte_t *pte;
-  struct proc *p = myproc();
+
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    /* CSE 536: an on-demand region may not even have page-table
+     * pages yet. */
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+      continue;
     if((*pte & PTE_V) == 0)
       continue;
       /* CSE 536: removed for on-demand allocation. */
@@ -190,12 +192,10 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      /* CSE 536: (2.6.1) Freeing Process Memory */
-      // Make sure that the shared pages, belonging to a CoW group, are not freed twice
-      if((is_shmem(p->cow_group, pa) && get_cow_group_count(p->cow_group)==1) || !is_shmem(p->cow_group, pa)){
-        kfree((void*)pa);
-      }
+      /* CSE 536: (2.6.1) Freeing Process Memory. Pages shared
+       * with CoW children or the text cache are reference counted,
+       * so this only frees the last mapping. */
+      kfree((void*)PTE2PA(*pte));
     }
     *pte = 0;
   }
@@ -323,11 +323,18 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+      continue;  // CSE 536: unmapped on-demand region
     if((*pte & PTE_V) == 0)
       continue;      
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & PTE_TEXT){
+      // CSE 536: shared program text is mapped, not copied.
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      krefinc((void*)pa);
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -376,13 +383,26 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
+  struct proc *p;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if (pa0 == 0){
+    if(va0 >= MAXVA)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
       return -1;
+    // CSE 536: honour read-only mappings as the MMU would. A text-cache
+    // page is shared by every process running the program, so it is
+    // never written; a CoW-shared page gets its own copy first.
+    if((*pte & PTE_W) == 0 || (*pte & PTE_TEXT)){
+      p = myproc();
+      if((*pte & PTE_TEXT) || p == 0 || p->pagetable != pagetable ||
+         p->cow_enabled != 1 || copy_on_write(p, va0) < 0)
+        return -1;
     }
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
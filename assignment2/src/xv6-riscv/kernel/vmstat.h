@@ -0,0 +1,16 @@
+// CSE 536: paging statistics, per process and system-wide.
+// Returned by getvmstats(); pid 0 asks for the system-wide totals.
+
+struct vmstats {
+  uint64 minflt;    // page faults served without reading the disk
+  uint64 majflt;    // page faults that read the disk
+  uint64 zerofill;  // heap pages mapped zero-filled
+  uint64 cowcopy;   // CoW faults that copied the page
+  uint64 cowreuse;  // CoW faults on the last reference, no copy
+  uint64 swapout;   // heap pages written to the PSA
+  uint64 swapin;    // heap pages read back from the PSA
+  uint64 pfcycles;  // cycles spent in page_fault_handler
+  uint64 resident;  // resident heap pages
+  uint64 psaused;   // PSA slots in use (for a process: slots it refers to)
+  uint64 psatotal;  // PSA slots
+};
@@ -0,0 +1,51 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+/* A read() into the program's own text must fail: the text page is
+ * shared through the text cache with every process running the program
+ * and with later execs of it. */
+
+int
+main(int argc, char *argv[])
+{
+    if (argc > 1) {
+        printf("[*] Second exec ran.\n");
+        return 0;
+    }
+    printf("Running Test11-TextRO\n");
+
+    /* Fault the text page in and remember what it holds. */
+    char *text = (char*)main;
+    char before[64];
+    memmove(before, text, sizeof(before));
+
+    int fd = open("README", O_RDONLY);
+    if (fd < 0) {
+        printf("[X] Cannot open README.\n");
+        return -1;
+    }
+    int n = read(fd, text, sizeof(before));
+    close(fd);
+    if (n >= 0 || memcmp(before, text, sizeof(before)) != 0)
+        goto fail;
+
+    /* The cached page must still hold the program's code. */
+    int pid = fork(0);
+    if (pid == 0) {
+        char *args[] = { "test11-textro", "again", 0 };
+        exec("test11-textro", args);
+        printf("[X] exec failed.\n");
+        exit(1);
+    }
+    int status;
+    if (pid < 0 || wait(&status) != pid || status != 0)
+        goto fail;
+
+    printf("[*] Text read-only test PASSED.\n");
+    return 0;
+
+fail:
+    printf("[X] Text read-only test FAILED.\n");
+    return -1;
+}
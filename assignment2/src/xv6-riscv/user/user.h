@@ -1,4 +1,5 @@
 struct stat;
+struct vmstats;
 
 // system calls
 int fork(int);
@@ -22,6 +23,7 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int getvmstats(int, struct vmstats*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -0,0 +1,84 @@
+// CSE 536: print paging statistics.
+//
+//   vmstat             system-wide totals
+//   vmstat pid...      statistics of the given processes
+//   vmstat cmd args    run cmd, then print the system-wide change
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+static void
+show(char *who, struct vmstats *st)
+{
+  printf("%s:\n", who);
+  printf("  faults    %l minor, %l major, %l cycles\n",
+         st->minflt, st->majflt, st->pfcycles);
+  printf("  zero-fill %l\n", st->zerofill);
+  printf("  cow       %l copied, %l reused\n", st->cowcopy, st->cowreuse);
+  printf("  swap      %l out, %l in\n", st->swapout, st->swapin);
+  printf("  resident  %l heap pages\n", st->resident);
+  printf("  psa       %l / %l slots\n", st->psaused, st->psatotal);
+}
+
+static int
+isnum(char *s)
+{
+  if(*s == 0)
+    return 0;
+  for(; *s; s++)
+    if(*s < '0' || *s > '9')
+      return 0;
+  return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+  struct vmstats st, before;
+  int i, pid;
+
+  if(argc < 2){
+    if(getvmstats(0, &st) < 0){
+      fprintf(2, "vmstat: getvmstats failed\n");
+      exit(1);
+    }
+    show("system", &st);
+    exit(0);
+  }
+
+  if(isnum(argv[1])){
+    for(i = 1; i < argc; i++){
+      if(getvmstats(atoi(argv[i]), &st) < 0){
+        fprintf(2, "vmstat: no process %s\n", argv[i]);
+        continue;
+      }
+      show(argv[i], &st);
+    }
+    exit(0);
+  }
+
+  getvmstats(0, &before);
+  if((pid = fork(0)) < 0){
+    fprintf(2, "vmstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "vmstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  getvmstats(0, &st);
+  st.minflt -= before.minflt;
+  st.majflt -= before.majflt;
+  st.pfcycles -= before.pfcycles;
+  st.zerofill -= before.zerofill;
+  st.cowcopy -= before.cowcopy;
+  st.cowreuse -= before.cowreuse;
+  st.swapout -= before.swapout;
+  st.swapin -= before.swapin;
+  show(argv[1], &st);
+  exit(0);
+}
@@ -86,10 +86,12 @@ extern uint64 	globtime;
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             growproc(int, uint64*);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
+void            proc_setvm(struct proc*, pagetable_t, uint64);
+int             clone(uint64, uint64, uint64);
 int             kill(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
@@ -62,6 +62,12 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   ...
+//   THREADFRAME(p) (trapframes of threads made by clone())
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// CSE 536: threads share their process's page table, so each maps
+// its trapframe at an address of its own, picked by its proc[] slot.
+#define THREADFRAME(p) (TRAPFRAME - ((p)+1)*PGSIZE)
@@ -27,6 +27,11 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// CSE 536: threads made by clone() share their process's page table.
+// Held while changing which page table a proc uses, or the mappings
+// or size of one that may be shared.
+struct spinlock vm_lock;
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -52,6 +57,7 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  initlock(&vm_lock, "vm_lock");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -107,8 +113,10 @@ allocpid()
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
+// CSE 536: if share is set, the new proc is a thread sharing share's
+// page table; otherwise it gets an empty one.
 static struct proc*
-allocproc(void)
+allocproc(struct proc *share)
 {
   struct proc *p;
 
@@ -133,8 +141,21 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
+  if(share){
+    // Map the trapframe into share's page table.
+    acquire(&vm_lock);
+    p->tfva = THREADFRAME((int) (p - proc));
+    if(mappages(share->pagetable, p->tfva, PGSIZE,
+                (uint64)(p->trapframe), PTE_R | PTE_W) == 0){
+      p->pagetable = share->pagetable;
+      p->sz = share->sz;
+    }
+    release(&vm_lock);
+  } else {
+    // An empty user page table.
+    p->tfva = TRAPFRAME;
+    p->pagetable = proc_pagetable(p);
+  }
   if(p->pagetable == 0){
     freeproc(p);
     release(&p->lock);
@@ -156,19 +177,17 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  proc_setvm(p, 0, 0);
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->alarm_ticks = 0;
   p->state = UNUSED;
 }
 
@@ -216,6 +235,38 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
   uvmfree(pagetable, sz);
 }
 
+// CSE 536: switch p to pagetable, of size sz, which maps p->trapframe
+// at TRAPFRAME (0 for no page table). The old page table, which
+// threads may share, loses p's trapframe, and is freed along with
+// its memory if no other proc uses it.
+void
+proc_setvm(struct proc *p, pagetable_t pagetable, uint64 sz)
+{
+  pagetable_t old;
+  uint64 oldsz;
+  struct proc *q;
+  int last = 1;
+
+  acquire(&vm_lock);
+  old = p->pagetable;
+  oldsz = p->sz;
+  if(old){
+    uvmunmap(old, p->tfva, 1, 0);
+    for(q = proc; q < &proc[NPROC]; q++)
+      if(q != p && q->pagetable == old)
+        last = 0;
+  }
+  p->pagetable = pagetable;
+  p->sz = sz;
+  p->tfva = TRAPFRAME;
+  release(&vm_lock);
+
+  if(old && last){
+    uvmunmap(old, TRAMPOLINE, 1, 0);
+    uvmfree(old, oldsz);
+  }
+}
+
 // a user program that calls exec("/init")
 // assembled from ../user/initcode.S
 // od -t xC ../user/initcode
@@ -235,7 +286,7 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy initcode's instructions
@@ -257,24 +308,41 @@ userinit(void)
 
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
+// CSE 536: the new size applies to every thread sharing the memory,
+// and the size before the change is stored in *oldsz. Shrinking memory
+// another thread shares fails: with no TLB shootdown, its hart could
+// keep using the freed pages.
 int
-growproc(int n)
+growproc(int n, uint64 *oldsz)
 {
   uint64 sz;
   struct proc *p = myproc();
+  struct proc *q;
 
   /* CSE 536: For simplicity, I've made all allocations at page-level. */
   n = PGROUNDUP(n);
 
-  sz = p->sz;
+  acquire(&vm_lock);
+  if(n < 0){
+    for(q = proc; q < &proc[NPROC]; q++)
+      if(q != p && q->pagetable == p->pagetable){
+        release(&vm_lock);
+        return -1;
+      }
+  }
+  sz = *oldsz = p->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+      release(&vm_lock);
       return -1;
     }
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  for(q = proc; q < &proc[NPROC]; q++)
+    if(q->pagetable == p->pagetable)
+      q->sz = sz;
+  release(&vm_lock);
   return 0;
 }
 
@@ -288,17 +356,21 @@ fork(void)
   struct proc *p = myproc();
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
   // Copy user memory from parent to child.
+  // CSE 536: a thread sharing p's memory may sbrk() meanwhile.
+  acquire(&vm_lock);
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+    release(&vm_lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  release(&vm_lock);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -329,6 +401,51 @@ fork(void)
   return pid;
 }
 
+// CSE 536: create a thread of the calling process: a new process that
+// shares its memory but has its own trapframe, kernel stack, and open
+// file descriptors (duplicated, as by fork), and starts in fn(arg) on
+// the user stack ending at stack. fn must not return; the thread ends
+// with exit() and is reaped by the caller's wait(). The memory is
+// freed once its last thread is reaped.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc(p)) == 0){
+    return -1;
+  }
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack;
+  np->trapframe->a0 = arg;
+  np->trapframe->ra = 0;
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
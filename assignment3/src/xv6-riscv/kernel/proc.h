@@ -103,8 +103,19 @@ struct proc {
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 tfva;                 // CSE 536: where trapframe is mapped
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+
+  /* CSE 536: periodic timer upcall, see sys_sigalarm(). */
+  int alarm_ticks;             // Timer ticks between upcalls, 0 if off
+  int alarm_left;              // Ticks until the next upcall
+  uint64 alarm_handler;        // User address of the handler
 };
+
+/* CSE 536: a timer upcall pushes the interrupted user registers on the
+ * user stack in this layout, and sigreturn() resumes from it:
+ * epc, then ra..t6 in trapframe order. */
+#define ALARMFRAME_SIZE (32*8)
@@ -21,3 +21,6 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_ctime  22
+#define SYS_sigalarm  23  // CSE 536
+#define SYS_sigreturn 24  // CSE 536
+#define SYS_clone  25  // CSE 536
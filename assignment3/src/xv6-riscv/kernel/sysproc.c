@@ -42,8 +42,7 @@ sys_sbrk(void)
   int n;
 
   argint(0, &n);
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, &addr) < 0)
     return -1;
 
   return addr;
@@ -96,3 +95,56 @@ sys_ctime(void)
 {
   return globtime;
 }
+
+/* CSE 536: call handler every ticks timer ticks that find the process
+ * in user mode; 0 ticks turns the upcall off. */
+uint64
+sys_sigalarm(void)
+{
+  int ticks;
+  uint64 handler;
+  struct proc *p = myproc();
+
+  argint(0, &ticks);
+  argaddr(1, &handler);
+  if(ticks < 0)
+    return -1;
+  p->alarm_ticks = ticks;
+  p->alarm_left = ticks;
+  p->alarm_handler = handler;
+  return 0;
+}
+
+/* CSE 536: resume the code a timer upcall interrupted, from the frame
+ * the upcall pushed. */
+uint64
+sys_sigreturn(void)
+{
+  uint64 frame, tp;
+  uint64 regs[ALARMFRAME_SIZE/8];
+  struct trapframe *tf = myproc()->trapframe;
+
+  argaddr(0, &frame);
+  if(copyin(myproc()->pagetable, (char*)regs, frame, sizeof(regs)) < 0)
+    return -1;
+  // tp stays as is: the ulthread library keeps per-kernel-thread state
+  // there, and may resume the frame on another kernel thread.
+  tp = tf->tp;
+  tf->epc = regs[0];
+  memmove(&tf->ra, &regs[1], sizeof(regs) - 8);
+  tf->tp = tp;
+  return tf->a0;  // syscall() stores the return value in a0
+}
+
+/* CSE 536: start a thread of this process in fn(arg) on the given
+ * user stack; see clone(). */
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
@@ -29,6 +29,25 @@ trapinithart(void)
   w_stvec((uint64)kernelvec);
 }
 
+// CSE 536: timer upcall. Push the interrupted user registers onto the
+// user stack and enter the handler with a pointer to them in a0; it
+// resumes the interrupted code with sigreturn(). Each upcall gets its
+// own frame, so a handler may switch stacks (e.g. to another user-level
+// thread) and return much later. Skipped if the stack has no room.
+static void
+alarm_upcall(struct proc *p)
+{
+  struct trapframe *tf = p->trapframe;
+  uint64 sp = (tf->sp - ALARMFRAME_SIZE) & ~0xfL;
+
+  if(copyout(p->pagetable, sp, (char*)&tf->epc, 8) < 0 ||
+     copyout(p->pagetable, sp + 8, (char*)&tf->ra, ALARMFRAME_SIZE - 8) < 0)
+    return;
+  tf->epc = p->alarm_handler;
+  tf->sp = sp;
+  tf->a0 = sp;
+}
+
 //
 // handle an interrupt, exception, or system call from user space.
 // called from trampoline.S
@@ -79,8 +98,13 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  if(which_dev == 2){
+    if(p->alarm_ticks > 0 && --p->alarm_left <= 0){
+      p->alarm_left = p->alarm_ticks;
+      alarm_upcall(p);
+    }
     yield();
+  }
 
   usertrapret();
 }
@@ -121,14 +145,15 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
+  // tell trampoline.S the user page table to switch to, and where
+  // in it p->trapframe is mapped.
   uint64 satp = MAKE_SATP(p->pagetable);
 
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64,uint64))trampoline_userret)(satp, p->tfva);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -0,0 +1,63 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/memlayout.h"
+#include "kernel/riscv.h"
+
+#include "user/ulthread.h"
+#include <stdarg.h>
+
+/* Stack region for different threads */
+char stacks[PGSIZE*MAXULTHREADS];
+
+#define NTHREADS 4
+
+/* Threads spin without ever yielding; only preemption lets the others
+ * run. Each stops once every thread has run at least once. */
+volatile uint64 spins[NTHREADS];
+volatile int stop;
+
+void ul_start_func(int slot) {
+    while (!stop) {
+        spins[slot]++;
+        int all = 1;
+        for (int i = 0; i < NTHREADS; i++)
+            if (spins[i] == 0)
+                all = 0;
+        if (all)
+            stop = 1;
+    }
+    ulthread_destroy();
+}
+
+int
+main(int argc, char *argv[])
+{
+    /* Clear the stack region */
+    memset(&stacks, 0, sizeof(stacks));
+
+    /* Where the timer preempts depends on timing; keep the trace quiet. */
+    ulthread_trace = false;
+
+    /* Initialize the user-level threading library */
+    ulthread_init(ROUNDROBIN);
+
+    for (int i = 0; i < NTHREADS; i++) {
+        uint64 args[6] = {i,0,0,0,0,0};
+        ulthread_create((uint64) ul_start_func, (uint64) stacks+PGSIZE*(i+1), args, -1);
+    }
+
+    /* Preempt every timer tick */
+    ulthread_set_timeslice(1);
+    ulthread_schedule();
+    ulthread_set_timeslice(0);
+
+    for (int i = 0; i < NTHREADS; i++)
+        printf("[.] thread %d ran\n", i+1);
+    printf("[*] User-Level Threading Test #6 Complete.\n");
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/riscv.h"
+
+#include "user/ulthread.h"
+
+/* CSE 536: context switch microbenchmark for the ulthread library.
+ *
+ *   ulbench [nthreads [yields]]
+ *
+ * Round-robins nthreads threads that each yield the given number of
+ * times, and reports how many handoffs per second that takes. */
+
+/* uptime() counts timer ticks, which only hart 0 advances, every
+ * 1000000 cycles, i.e. ten times a second in qemu. (ctime() is no use
+ * here: every hart adds to globtime, so it runs CPUS times too fast.) */
+#define TICKS_PER_SEC 10
+
+/* Stack region for different threads */
+char stacks[PGSIZE*MAXULTHREADS];
+
+void ul_bench_func(int yields) {
+    for (int i = 0; i < yields; i++)
+        ulthread_yield();
+    ulthread_destroy();
+}
+
+int
+main(int argc, char *argv[])
+{
+    int nthreads = argc > 1 ? atoi(argv[1]) : 2;
+    int yields = argc > 2 ? atoi(argv[2]) : 100000;
+
+    if (nthreads < 1 || nthreads >= MAXULTHREADS) {
+        fprintf(2, "ulbench: nthreads must be 1..%d\n", MAXULTHREADS-1);
+        exit(1);
+    }
+
+    ulthread_trace = false;
+    ulthread_init(ROUNDROBIN);
+
+    uint64 args[6] = {yields,0,0,0,0,0};
+    for (int i = 0; i < nthreads; i++)
+        ulthread_create((uint64) ul_bench_func, (uint64) (stacks+((i+1)*PGSIZE)), args, -1);
+
+    uint64 start = uptime();
+    ulthread_schedule();
+    uint64 elapsed = uptime() - start;
+
+    uint64 switches = (uint64) nthreads * yields;
+    printf("ulbench: %d threads, %l switches in %l ticks\n",
+        nthreads, switches, elapsed);
+    if (elapsed > 0)
+        printf("ulbench: %l switches/s\n", switches * TICKS_PER_SEC / elapsed);
+    exit(0);
+}
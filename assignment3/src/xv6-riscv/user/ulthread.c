@@ -7,22 +7,265 @@
 
 /* Standard definitions */
 #include <stdbool.h>
-#include <stddef.h> 
+#include <stddef.h>
+
+void ulthread_trampoline(void);
+static void ulthread_preempt(uint64 frame);
 
 struct scheduler_thread main_thread;
-struct uthread *current_thread;
-struct uthread *last_yielded_thread;
-int scheduled_index_thread = -1;
 
-int thread_count = 1; 
+/* Print the [*] scheduling trace; benchmarks turn it off. */
+bool ulthread_trace = true;
+
+/* Timer ticks per slice, 0 if threads are not preempted. */
+static int timeslice;
+
+/* Stacks the workers started by ulthread_schedule() schedule on, two
+ * pages each above a guard page. xv6 cannot unmap a page from user
+ * space, so the guard is filled with GUARDBYTE and checked once the
+ * worker has exited. */
+#define WORKERSTACK (2*4096)
+#define STACKGUARD  4096
+#define GUARDBYTE   0x5a
+static char worker_stacks[ULTWORKERS][STACKGUARD + WORKERSTACK] __attribute__((aligned(4096)));
+
+/* Failed polls for work before an idle worker sleeps for a tick. */
+#define IDLESPIN 100
+
+int thread_count = 1;
+
+/* Workers. Every kernel thread running user-level threads keeps its
+ * struct ulworker in tp, which nothing else in user space uses.
+ *
+ * While in the library a worker is busy, so the timer upcall does not
+ * preempt it. busy is set and cleared with one access through tp, so a
+ * thread cannot move to another worker between finding its worker and
+ * marking it. enter() returns the old value. Whoever runs after a
+ * context switch clears it: the code returning from the switch, or,
+ * for a new thread, ulthread_started(). */
+static inline struct ulworker *self(void) {
+    struct ulworker *w;
+    asm volatile("mv %0, tp" : "=r" (w));
+    return w;
+}
+
+static inline int enter(void) {
+    int busy;
+    asm volatile("amoswap.w %0, %1, (tp)" : "=r" (busy) : "r" (1) : "memory");
+    return busy;
+}
+
+static inline void leave(void) {
+    asm volatile("sw zero, 0(tp)" : : : "memory");
+}
+
+/* Spinlocks between workers, held only while busy. */
+static void spin_lock(int *l) {
+    while (__sync_lock_test_and_set(l, 1) != 0)
+        ;
+    __sync_synchronize();
+}
+
+static void spin_unlock(int *l) {
+    __sync_synchronize();
+    __sync_lock_release(l);
+}
+
+/* The timer upcall may interrupt a thread anywhere, even in the middle
+ * of its own printf, so it only records a preemption. The worker traces
+ * it from its next library call that is not an upcall. */
+static void trace_preempts(struct ulworker *w) {
+    for (int i = 0; i < w->npreempt && i < ULTPREEMPTLOG; i++)
+        printf("[*] ultpreempt(tid: %d)\n", w->preempted[i]);
+    if (w->npreempt > ULTPREEMPTLOG)
+        printf("[*] ultpreempt: %d more not traced\n", w->npreempt - ULTPREEMPTLOG);
+    w->npreempt = 0;
+}
+
 /* Get thread ID */
 int get_current_tid(void) {
-    return current_thread->tid;
+    int tid;
+
+    enter();
+    tid = self()->current->tid;
+    leave();
+    return tid;
+}
+
+/* Run queues. Every operation is O(1), so scheduling cost does not grow
+ * with MAXULTHREADS or the number of threads. */
+static void enqueue(struct ulthread_queue *q, struct uthread *t) {
+    t->next = NULL;
+    if (q->tail)
+        q->tail->next = t;
+    else
+        q->head = t;
+    q->tail = t;
+}
+
+static struct uthread *dequeue(struct ulthread_queue *q) {
+    struct uthread *t = q->head;
+    if (t) {
+        q->head = t->next;
+        if (q->head == NULL)
+            q->tail = NULL;
+        t->next = NULL;
+    }
+    return t;
+}
+
+/* Index of the highest set bit in x, which must be non-zero. */
+static int highbit(uint64 x) {
+    int n = 0;
+    if (x >> 32) { n += 32; x >>= 32; }
+    if (x >> 16) { n += 16; x >>= 16; }
+    if (x >> 8)  { n += 8;  x >>= 8; }
+    if (x >> 4)  { n += 4;  x >>= 4; }
+    if (x >> 2)  { n += 2;  x >>= 2; }
+    if (x >> 1)  n += 1;
+    return n;
+}
+
+static void prio_enqueue(struct ulworker *w, struct uthread *t) {
+    enqueue(&w->prio[t->priority], t);
+    w->priomap |= 1UL << t->priority;
+}
+
+static struct uthread *prio_dequeue(struct ulworker *w) {
+    if (w->priomap == 0)
+        return NULL;
+    int p = highbit(w->priomap);
+    struct uthread *t = dequeue(&w->prio[p]);
+    if (w->prio[p].head == NULL)
+        w->priomap &= ~(1UL << p);
+    return t;
+}
+
+/* Put a new thread, or one that yielded, in line on this worker. */
+static void make_runnable(struct uthread *t) {
+    struct ulworker *w = self();
+
+    t->state = RUNNABLE;
+    spin_lock(&w->lock);
+    if (main_thread.schedalgo == PRIORITY)
+        prio_enqueue(w, t);
+    else
+        enqueue(&w->ready, t);
+    spin_unlock(&w->lock);
+}
+
+/* Whether w's run queue looks non-empty; a hint read without the lock,
+ * so idle workers do not keep taking the others' locks. */
+static bool has_work(struct ulworker *w) {
+    return __atomic_load_n(&w->ready.head, __ATOMIC_RELAXED) != NULL ||
+        __atomic_load_n(&w->priomap, __ATOMIC_RELAXED) != 0;
+}
+
+/* Take the next thread off w's run queue, or NULL if it is empty.
+ * Under PRIORITY, only a thread of priority minprio or higher. */
+static struct uthread *take(struct ulworker *w, int minprio) {
+    struct uthread *t = NULL;
+
+    spin_lock(&w->lock);
+    if (main_thread.schedalgo != PRIORITY)
+        t = dequeue(&w->ready);
+    else if (w->priomap != 0 && highbit(w->priomap) >= minprio)
+        t = prio_dequeue(w);
+    spin_unlock(&w->lock);
+    return t;
+}
+
+/* Next thread for w to run, or NULL if there is none: its own first,
+ * else one stolen from the next worker that has any. Under PRIORITY,
+ * only threads of priority minprio or higher are considered. */
+static struct uthread *pick_next(struct ulworker *w, int minprio) {
+    int n = main_thread.nworkers;
+    int me = w - main_thread.workers;
+    struct uthread *t = take(w, minprio);
+
+    for (int i = 1; t == NULL && i < n; i++) {
+        struct ulworker *v = &main_thread.workers[(me + i) % n];
+        if (has_work(v))
+            t = take(v, minprio);
+    }
+    return t;
+}
+
+/* Finish a context switch on this worker. The thread switched away
+ * from is only put back in line, or its slot freed, once its registers
+ * are saved; until then no other worker can pick it up. */
+static void finish_switch(void) {
+    struct ulworker *w = self();
+
+    if (w->requeue) {
+        make_runnable(w->requeue);
+        w->requeue = NULL;
+    }
+    if (w->dead) {
+        spin_lock(&main_thread.lock);
+        w->dead->next = main_thread.free;
+        main_thread.free = w->dead;
+        spin_unlock(&main_thread.lock);
+        w->dead = NULL;
+    }
+}
+
+static void context_switch(struct context *from, struct context *to) {
+    ulthread_context_switch(from, to);
+    finish_switch();
+}
+
+/* A new thread's first code, called by ulthread_trampoline. */
+void ulthread_started(void) {
+    finish_switch();
+    leave();
+}
+
+/* Hand the worker from the current thread t, which yields or, if dead,
+ * is destroyed, straight to the next runnable thread. The scheduler
+ * context is only re-entered when nothing is runnable, so a handoff
+ * costs one context switch instead of two. From the timer upcall
+ * (upcall set) nothing is traced. */
+static void switch_next(struct uthread *t, bool dead, bool upcall) {
+    struct ulworker *w = self();
+    struct uthread *next = NULL;
+
+    /* First come, first served: a yielding thread keeps its place at
+     * the front. Otherwise it lets any other runnable thread go first,
+     * even one of lower priority, unless it was preempted: time-slicing
+     * only rotates among threads of its priority or higher. */
+    int minprio = 0;
+    if (upcall && !dead && main_thread.schedalgo == PRIORITY)
+        minprio = t->priority;
+    if (dead || main_thread.schedalgo != FCFS)
+        next = pick_next(w, minprio);
+
+    if (next == NULL && dead) {
+        w->dead = t;
+        context_switch(&t->context, &w->context);  /* Does not return. */
+    }
+    if (next == NULL)
+        next = t;
+
+    /* Add this statement to denote which thread-id is being scheduled next */
+    if (ulthread_trace && !upcall)
+        printf("[*] ultschedule (next tid: %d)\n", next->tid);
+
+    /* Yielding to itself: keep running. */
+    if (next == t)
+        return;
+    if (dead)
+        w->dead = t;
+    else
+        w->requeue = t;
+    w->current = next;
+    context_switch(&t->context, &next->context);
 }
 
 /* Thread initialization */
 void ulthread_init(int schedalgo) {
-    for(int i=0 ; i<MAXULTHREADS; i++)
+    main_thread.free = NULL;
+    for(int i=MAXULTHREADS-1 ; i>=0; i--)
     {
 	main_thread.uthreads[i].tid = -1;
 	main_thread.uthreads[i].priority = -1;
@@ -30,155 +273,240 @@ void ulthread_init(int schedalgo) {
 	main_thread.uthreads[i].start_func = -1;
 	main_thread.uthreads[i].stack_pointer = -1;
 	main_thread.uthreads[i].time = -1;
+	main_thread.uthreads[i].next = main_thread.free;
+	main_thread.free = &main_thread.uthreads[i];
     }
+    memset(main_thread.workers, 0, sizeof(main_thread.workers));
+    main_thread.nworkers = 1;
+    main_thread.lock = 0;
     main_thread.tid = 0;
     main_thread.thread_count = 0;
     main_thread.schedalgo = schedalgo;
+
+    /* The calling kernel thread is worker 0. */
+    asm volatile("mv tp, %0" : : "r" (&main_thread.workers[0]));
 }
 
 /* Thread creation */
 bool ulthread_create(uint64 start, uint64 stack, uint64 args[], int priority) {
-    int index = -1;
-    for(int i =0; i<MAXULTHREADS; i++)
-    {
-	if(main_thread.uthreads[i].state == FREE)
-        {
-	   index = i;
-	   main_thread.uthreads[i].tid = thread_count;
-	   main_thread.uthreads[i].priority = priority;
-	   main_thread.uthreads[i].state = RUNNABLE;
-	   main_thread.uthreads[i].start_func = start;
-	   main_thread.uthreads[i].stack_pointer = stack;
-	   main_thread.uthreads[i].time = ctime();
-
-	   break;
-	}
-    }
-    memset(&main_thread.uthreads[index].context, 0, sizeof(main_thread.uthreads[index].context));
-    
-    main_thread.uthreads[index].context.ra = start;
-    main_thread.uthreads[index].context.sp = stack;
-
-    main_thread.uthreads[index].context.a0 = args[0];
-    main_thread.uthreads[index].context.a1 = args[1];
-    main_thread.uthreads[index].context.a2 = args[2];
-    main_thread.uthreads[index].context.a3 = args[3];
-    main_thread.uthreads[index].context.a4 = args[4];
-    main_thread.uthreads[index].context.a5 = args[5];
+    struct uthread *t;
 
+    enter();
+    spin_lock(&main_thread.lock);
+    t = main_thread.free;
+    if (t == NULL) {
+        spin_unlock(&main_thread.lock);
+        leave();
+        return false;
+    }
+    main_thread.free = t->next;
+    t->tid = thread_count;
     thread_count += 1;
-    
+    spin_unlock(&main_thread.lock);
+
+    /* Priorities outside 0..ULTPRIOS-1 are clamped into range. */
+    if (priority < 0)
+        priority = 0;
+    if (priority >= ULTPRIOS)
+        priority = ULTPRIOS-1;
+
+    t->priority = priority;
+    t->start_func = start;
+    t->stack_pointer = stack;
+    t->time = ctime();
+
+    memset(&t->context, 0, sizeof(t->context));
+
+    /* The first switch to the thread enters the trampoline, which calls
+     * start with the arguments kept in s1-s6. */
+    t->context.ra = (uint64) ulthread_trampoline;
+    t->context.sp = stack;
+    t->context.s0 = start;
+    t->context.s1 = args[0];
+    t->context.s2 = args[1];
+    t->context.s3 = args[2];
+    t->context.s4 = args[3];
+    t->context.s5 = args[4];
+    t->context.s6 = args[5];
+
+    make_runnable(t);
+
     /* Please add thread-id instead of '0' here. */
-    printf("[*] ultcreate(tid: %d, ra: %p, sp: %p)\n", main_thread.uthreads[index].tid, start, stack);
-    return false;
+    if (ulthread_trace) {
+        trace_preempts(self());
+        printf("[*] ultcreate(tid: %d, ra: %p, sp: %p)\n", t->tid, start, stack);
+    }
+    leave();
+    return true;
 }
 
-/* Thread scheduler */
-void ulthread_schedule(void) {
-    while(thread_count > 1)
+/* Run threads on worker w until none is left. Threads hand off to each
+ * other directly (see switch_next()); control comes back here once none
+ * is runnable on w. */
+static void run_worker(struct ulworker *w) {
+    struct uthread *t;
+    int idle = 0;
+
+    while(__atomic_load_n(&thread_count, __ATOMIC_ACQUIRE) > 1)
     {
-	if(current_thread == NULL)
-	{
-	  for(int i=0; i<MAXULTHREADS; i++)
-	  {
-	     if(main_thread.uthreads[i].state == RUNNABLE)
-	     {
-		current_thread = &main_thread.uthreads[i];
-		//scheduled_index_thread = i;
-		break;
-	     }
-	  }
-	}
-	if(main_thread.schedalgo == FCFS)
-      	{
-	  for(int i =0; i<MAXULTHREADS; i++)
-	  {
-	     if (main_thread.uthreads[i].state != RUNNABLE)
-		continue;
-	     
-	     
-	     else if(current_thread->time > main_thread.uthreads[i].time)
-	     {
-		current_thread = &main_thread.uthreads[i];
-		//scheduled_index_thread = i;
-	     }
-	  }
-	}
-	else if(main_thread.schedalgo == ROUNDROBIN)
-	{
-	  for(int i=0; i<MAXULTHREADS; i++)
-	  {
-	     if(main_thread.uthreads[i].state != RUNNABLE)
-		continue;
-	     if(main_thread.uthreads[i].time < current_thread->time)
-	     {
-		current_thread = &main_thread.uthreads[i];
-		//scheduled_index_thread = i+1;
-	     }
-	    
-	  }
+	/* Nothing to run or steal: others are still running threads.
+	 * Poll for a while, then give the hart up until the next tick. */
+	if((t = pick_next(w, 0)) == NULL) {
+	   if(++idle >= IDLESPIN) {
+	      sleep(1);
+	      idle = 0;
+	   }
+	   continue;
 	}
-	else if(main_thread.schedalgo == PRIORITY)
-	{
-	  for(int i=0; i<MAXULTHREADS; i++)
-	  {
-	     if(main_thread.uthreads[i].state != RUNNABLE)
-		continue;
-		
-	     if(current_thread->tid == last_yielded_thread->tid && main_thread.uthreads[i].tid != last_yielded_thread->tid)
-	     {
-		current_thread = &main_thread.uthreads[i];
-		continue;
-	     }
-	     if(main_thread.uthreads[i].tid != last_yielded_thread->tid && main_thread.uthreads[i].priority >= current_thread->priority)
-	     {
-	        current_thread = &main_thread.uthreads[i];
-		//scheduled_index_thread = i;
-	     }
-	  }	
-	 
+	idle = 0;
+
+	/* Add this statement to denote which thread-id is being scheduled next */
+	if (ulthread_trace) {
+	    trace_preempts(w);
+	    printf("[*] ultschedule (next tid: %d)\n", t->tid);
 	}
 
- 	printf("[*] ultschedule (next tid: %d)\n", current_thread->tid);
- 	ulthread_context_switch(&main_thread.context, &current_thread->context);
-	
-     
-    } 
-   // printf("Globtime Working: %d\n",ctime());  
-    /* Add this statement to denote which thread-id is being scheduled next */
-  	
-    // Switch between thread contexts
+	// Switch between thread contexts
+	w->current = t;
+	context_switch(&w->context, &t->context);
+    }
+    w->current = NULL;
+    trace_preempts(w);
+}
+
+/* Entry of the kernel threads ulthread_schedule() starts. */
+static void worker_main(uint64 id) {
+    struct ulworker *w = &main_thread.workers[id];
+
+    asm volatile("mv tp, %0" : : "r" (w));
+    enter();
+    if (timeslice > 0)
+        sigalarm(timeslice, ulthread_preempt);
+    run_worker(w);
+    exit(0);
+}
+
+/* Thread scheduler. Runs the threads on the calling kernel thread and
+ * nworkers-1 more (see ulthread_set_workers()), and returns once all
+ * of them are destroyed. */
+void ulthread_schedule(void) {
+    int pids[ULTWORKERS];
+    int started = 0;
+
+    enter();
+    for (int i = 1; i < main_thread.nworkers; i++) {
+        memset(worker_stacks[i], GUARDBYTE, STACKGUARD);
+        int pid = clone(worker_main, i, worker_stacks[i] + STACKGUARD + WORKERSTACK);
+        if (pid > 0)
+            pids[started++] = pid;
+    }
+    run_worker(self());
+
+    /* wait() reaps any child, including the program's own; keep going
+     * until every worker is among them. */
+    while (started > 0) {
+        int pid = wait(0);
+        if (pid < 0)
+            break;
+        for (int k = 0; k < started; k++) {
+            if (pids[k] == pid) {
+                pids[k] = pids[--started];
+                break;
+            }
+        }
+    }
+    for (int i = 1; i < main_thread.nworkers; i++) {
+        for (int k = 0; k < STACKGUARD; k++) {
+            if (worker_stacks[i][k] != GUARDBYTE) {
+                printf("ulthread: worker %d overflowed its stack\n", i);
+                exit(1);
+            }
+        }
+    }
+    leave();
 }
 
 /* Yield CPU time to some other thread. */
 void ulthread_yield(void) {
-    if(main_thread.schedalgo != FCFS)
-	current_thread->time = ctime();
-    
-    last_yielded_thread = current_thread;
+    struct uthread *t;
+
+    enter();
+    t = self()->current;
+
     /* Please add thread-id instead of '0' here. */
-    printf("[*] ultyield(tid: %d)\n", current_thread->tid);
-    ulthread_context_switch(&current_thread->context, &main_thread.context);
+    if (ulthread_trace) {
+        trace_preempts(self());
+        printf("[*] ultyield(tid: %d)\n", t->tid);
+    }
+    switch_next(t, false, false);
+    leave();
 }
 
 /* Destroy thread */
 void ulthread_destroy(void) {
-    last_yielded_thread = current_thread;
-    printf("[*] ultdestroy(tid: %d)\n", current_thread->tid); 
-    for(int i=0; i<MAXULTHREADS; i++)
-    {
-	if(main_thread.uthreads[i].tid == current_thread->tid)
-	{
-	   main_thread.uthreads[i].tid = -1;
-           main_thread.uthreads[i].priority = -1;
-           main_thread.uthreads[i].state = FREE;
-           main_thread.uthreads[i].start_func = -1;
-           main_thread.uthreads[i].stack_pointer = -1;
-	   main_thread.uthreads[i].time = -1;
-	   break;
-	}
+    struct uthread *t;
+
+    enter();
+    t = self()->current;
+    if (ulthread_trace) {
+        trace_preempts(self());
+        printf("[*] ultdestroy(tid: %d)\n", t->tid);
     }
+    t->tid = -1;
+    t->priority = -1;
+    t->state = FREE;
+    t->start_func = -1;
+    t->stack_pointer = -1;
+    t->time = -1;
+
+    spin_lock(&main_thread.lock);
     thread_count -= 1;
+    spin_unlock(&main_thread.lock);
+
+    /* The slot is freed once this switch has saved into it. */
+    switch_next(t, true, false);
+}
+
+/* Timer upcall (see ulthread_set_timeslice()): the running thread's
+ * slice is over, so put it back in line as if it had yielded. frame
+ * holds its interrupted registers; it resumes from them once it is
+ * scheduled again, possibly on another worker. Nothing is printed
+ * here; see trace_preempts(). */
+static void ulthread_preempt(uint64 frame) {
+    if (enter() == 0) {
+        struct ulworker *w = self();
+        struct uthread *t = w->current;
+        if (t != NULL) {
+            if (ulthread_trace && w->npreempt++ < ULTPREEMPTLOG)
+                w->preempted[w->npreempt - 1] = t->tid;
+            switch_next(t, false, true);
+        }
+        leave();
+    }
+    sigreturn(frame);
+}
+
+/* Preempt the running thread after every ticks timer ticks it spends
+ * running in user mode; 0 goes back to cooperative scheduling. Applies
+ * to the calling kernel thread and the workers ulthread_schedule()
+ * starts. Threads may then be interrupted anywhere outside this
+ * library, so code they share (e.g. malloc) must not be in use by two
+ * of them at once. */
+void ulthread_set_timeslice(int ticks) {
+    timeslice = ticks;
+    sigalarm(ticks, ticks > 0 ? ulthread_preempt : 0);
+}
 
-    ulthread_context_switch(&current_thread->context, &main_thread.context);
+/* Run threads on n kernel threads (workers), so on up to n harts at
+ * once, from the next ulthread_schedule() on; call after
+ * ulthread_init(). Threads are queued on the worker that creates or
+ * last ran them, and a worker with none left steals from the others.
+ * With more than one worker, threads run in parallel, and the
+ * scheduling order holds per worker only. */
+void ulthread_set_workers(int n) {
+    if (n < 1)
+        n = 1;
+    if (n > ULTWORKERS)
+        n = ULTWORKERS;
+    main_thread.nworkers = n;
 }
@@ -4,6 +4,9 @@
 #include <stdbool.h>
 
 #define MAXULTHREADS 100
+#define ULTPRIOS     64       // PRIORITY levels, 0 (lowest) to ULTPRIOS-1
+#define ULTWORKERS   8        // most kernel threads running ulthreads
+#define ULTPREEMPTLOG 16      // preemptions a worker records until traced
 
 enum ulthread_state {
   FREE,
@@ -17,6 +20,9 @@ enum ulthread_scheduling_algorithm {
   FCFS,         // first-come-first serve
 };
 
+/* Callee-saved registers: everything a thread needs preserved across
+ * ulthread_context_switch(). A new thread starts in ulthread_trampoline
+ * with its start function in s0 and its arguments in s1-s6. */
 struct context{
   uint64 ra;
   uint64 sp;
@@ -33,13 +39,6 @@ struct context{
   uint64 s9;
   uint64 s10;
   uint64 s11;
-  uint64 a0;
-  uint64 a1;
-  uint64 a2;
-  uint64 a3;
-  uint64 a4;
-  uint64 a5;
-
 };
 
 struct uthread{
@@ -50,14 +49,49 @@ struct uthread{
   uint64 stack_pointer;				// Thread's Stack base address
   enum ulthread_state state;			// Free, Runnable or Yield
   struct context context;
+  struct uthread *next;				// Run queue or free list link
+
+};
+
+/* FIFO of runnable threads, linked through uthread.next. */
+struct ulthread_queue{
+  struct uthread *head;
+  struct uthread *tail;
+};
 
+extern bool ulthread_trace;
+
+/* Preempt threads every ticks timer ticks; 0 turns preemption off. */
+void ulthread_set_timeslice(int ticks);
+
+/* Run threads on n kernel threads from the next ulthread_schedule(). */
+void ulthread_set_workers(int n);
+
+/* A kernel thread running user-level threads. Each keeps its own in
+ * tp; busy must come first, as leave() clears it there. */
+struct ulworker{
+  int busy;					// In the library: no preemption
+  int lock;					// Guards the run queues
+  struct uthread *current;			// Thread running on this worker
+  struct context context;			// Scheduler loop, ulthread_schedule()
+  struct ulthread_queue ready;			// FCFS and ROUNDROBIN
+  struct ulthread_queue prio[ULTPRIOS];		// PRIORITY, one FIFO per level
+  uint64 priomap;				// Bit i set if prio[i] is non-empty
+  struct uthread *requeue;			// Switched away from, to run again
+  struct uthread *dead;				// Switched away from, destroyed
+  int npreempt;					// Preemptions not yet traced
+  int preempted[ULTPREEMPTLOG];			// Their tids, oldest first
 };
 
 struct scheduler_thread{
   int tid;
   int thread_count;
   struct uthread uthreads[MAXULTHREADS];
-  struct context context;
   enum ulthread_scheduling_algorithm schedalgo;
+
+  int lock;					// Guards free and the thread count
+  struct uthread *free;				// Unused uthreads[] slots
+  int nworkers;
+  struct ulworker workers[ULTWORKERS];
 };
 #endif
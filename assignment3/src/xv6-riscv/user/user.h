@@ -23,6 +23,9 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int ctime(void);
+int sigalarm(int, void (*)(uint64));
+int sigreturn(uint64);
+int clone(void (*)(uint64), uint64, void*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -35,4 +35,8 @@ entry("dup");
 entry("getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
\ No newline at end of file
+entry("uptime");
+entry("ctime");
+entry("sigalarm");
+entry("sigreturn");
+entry("clone");
\ No newline at end of file